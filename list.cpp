@@ -1,5 +1,260 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// File descriptor overloads of List::SerializeTo / Deserialize and
+// PersistentList need POSIX.
+#ifndef LIST_POSIX_IO
+#if defined(__unix__) || defined(__APPLE__)
+#define LIST_POSIX_IO 1
+#else
+#define LIST_POSIX_IO 0
+#endif
+#endif
+
+#if LIST_POSIX_IO
+#include <cerrno>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Instrumentation of List. With LIST_ENABLE_STATS=0 (the default) the hooks
+// compile to nothing and List carries no extra members; Stats() then returns
+// a snapshot with enabled == false. LIST_STATS_LATENCY=1 additionally times
+// EmplaceBack and PopFront.
+#ifndef LIST_ENABLE_STATS
+#define LIST_ENABLE_STATS 0
+#endif
+
+#ifndef LIST_STATS_LATENCY
+#define LIST_STATS_LATENCY 0
+#endif
+
+// Power-of-two latency histogram: bucket i counts operations that took
+// [2^i, 2^(i + 1)) nanoseconds, bucket 0 also counts 0 ns.
+struct LatencyHistogram {
+  static constexpr size_t kBuckets = 32;
+
+  void Record(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && (nanoseconds >> (bucket + 1)) != 0) {
+      ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    total_ns += nanoseconds;
+  }
+
+  uint64_t buckets[kBuckets] = {};
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+};
+
+struct ListStats {
+  bool enabled = false;
+  // Current state.
+  size_t size = 0;
+  size_t cached_nodes = 0;
+  // Bytes of nodes held by the list: elements, cached nodes and spare slab
+  // nodes. Bookkeeping blocks and the inline sentinel are not included.
+  size_t bytes_held = 0;
+  // History of this list object, carried over by the move constructor.
+  size_t peak_size = 0;
+  size_t make_node_calls = 0;
+  size_t clean_list_calls = 0;
+  size_t cleaned_nodes = 0;
+  size_t node_allocations = 0;
+  size_t node_deallocations = 0;
+  size_t slab_allocations = 0;
+  LatencyHistogram emplace_back_latency;
+  LatencyHistogram pop_front_latency;
+};
+
+#if LIST_ENABLE_STATS && LIST_STATS_LATENCY
+// Records the lifetime of the scope into a histogram.
+class LatencyScope {
+  public:
+  explicit LatencyScope(LatencyHistogram& histogram)
+      : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+  LatencyScope(const LatencyScope&) = delete;
+  LatencyScope& operator=(const LatencyScope&) = delete;
+
+  ~LatencyScope() {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    histogram_.Record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+            .count()));
+  }
+
+  private:
+  LatencyHistogram& histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+#endif
+
+// Destroys detached node chains (see List::ClearAsync) off the calling
+// thread: on a thread of its own, or through a caller supplied executor
+// which is handed one task per chain. The backlog is bounded by
+// max_backlog nodes: a chain that would not fit next to the others is
+// reclaimed on the calling thread instead. The destructor flushes the
+// backlog.
+class ListReclaimer {
+  public:
+  using Task = std::function<void()>;
+  using Executor = std::function<void(Task)>;
+
+  static constexpr size_t kDefaultMaxBacklog = size_t{1} << 26;
+
+  // Something to destroy; its destructor does the work.
+  class Garbage {
+    public:
+    virtual ~Garbage() = default;
+  };
+
+  explicit ListReclaimer(size_t max_backlog = kDefaultMaxBacklog)
+      : max_backlog_(max_backlog), thread_([this] { Run(); }) {}
+
+  // The executor must eventually run every task it is handed; if it throws,
+  // the chain is reclaimed on the calling thread.
+  explicit ListReclaimer(Executor executor,
+                         size_t max_backlog = kDefaultMaxBacklog)
+      : max_backlog_(max_backlog), executor_(std::move(executor)) {}
+
+  ListReclaimer(const ListReclaimer&) = delete;
+  ListReclaimer& operator=(const ListReclaimer&) = delete;
+
+  ~ListReclaimer() {
+    Flush();
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_one();
+      thread_.join();
+    }
+  }
+
+  // The reclaimer used by lists that were not given one.
+  static ListReclaimer& Default() {
+    static ListReclaimer reclaimer;
+    return reclaimer;
+  }
+
+  // Takes garbage holding nodes nodes. Never throws: garbage that can not be
+  // queued is destroyed right away.
+  void Submit(std::unique_ptr<Garbage> garbage, size_t nodes) noexcept {
+    bool queued = false;
+    try {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (backlog_ == 0 || backlog_ + nodes <= max_backlog_) {
+        if (!executor_) {
+          queue_.emplace_back(garbage.get(), nodes);
+        }
+        backlog_ += nodes;
+        queued = true;
+      }
+    } catch (...) {
+    }
+    if (!queued) {
+      garbage.reset();
+      return;
+    }
+    if (!executor_) {
+      garbage.release();
+      wake_.notify_one();
+      return;
+    }
+    Garbage* raw = garbage.get();
+    try {
+      executor_([this, raw, nodes] {
+        delete raw;
+        Done(nodes);
+      });
+      garbage.release();
+    } catch (...) {
+      garbage.reset();
+      Done(nodes);
+    }
+  }
+
+  // Waits until everything submitted so far has been destroyed.
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return backlog_ == 0; });
+  }
+
+  // Nodes submitted but not destroyed yet.
+  [[nodiscard]] size_t Backlog() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return backlog_;
+  }
+
+  [[nodiscard]] size_t MaxBacklog() const { return max_backlog_; }
+
+  private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      auto [garbage, nodes] = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      delete garbage;
+      lock.lock();
+      backlog_ -= nodes;
+      if (backlog_ == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+
+  void Done(size_t nodes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    backlog_ -= nodes;
+    if (backlog_ == 0) {
+      done_.notify_all();
+    }
+  }
+
+  const size_t max_backlog_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::deque<std::pair<Garbage*, size_t>> queue_;
+  size_t backlog_ = 0;
+  bool stop_ = false;
+  Executor executor_;
+  // Declared last: it starts running in the constructor.
+  std::thread thread_;
+};
 
 template <typename T, typename Allocator = std::allocator<T>>
 class List {
@@ -11,9 +266,13 @@ class List {
   using allocator_type = Allocator;
   using iterator = ListIterator<false>;
   using const_iterator = ListIterator<true>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   List();
 
+  explicit List(const Allocator& alloc);
+
   explicit List(size_t count, const T& value,
                 const Allocator& alloc = Allocator());
 
@@ -28,9 +287,17 @@ class List {
 
   ~List();
 
+  // Copy assignment assigns into the existing nodes and only allocates the
+  // missing ones. The strong guarantee holds when assigning T can not throw;
+  // a throwing assignment leaves the size unchanged with some elements
+  // already overwritten (basic guarantee).
   List& operator=(const List& other);
   List& operator=(List&& other) noexcept;
 
+  // Exchanges the contents (and the node caches) of two lists without
+  // allocating. Allocators are swapped if propagate_on_container_swap.
+  void Swap(List& other) noexcept;
+
   [[nodiscard]] size_t Size() const { return size_; };
 
   [[nodiscard]] bool Empty() const { return size_ == 0; }
@@ -41,6 +308,20 @@ class List {
   [[nodiscard]] iterator End() const;
   [[nodiscard]] const_iterator Cend() const;
 
+  [[nodiscard]] reverse_iterator Rbegin() const;
+  [[nodiscard]] const_reverse_iterator Crbegin() const;
+  [[nodiscard]] reverse_iterator Rend() const;
+  [[nodiscard]] const_reverse_iterator Crend() const;
+
+  // The standard spelling for range-for, std algorithms and std::ranges
+  // (List is a bidirectional_range, and views::all makes a view of it).
+  // Unlike Begin(), begin() of a const list yields a const_iterator.
+  [[nodiscard]] iterator begin() { return Begin(); }
+  [[nodiscard]] iterator end() { return End(); }
+  [[nodiscard]] const_iterator begin() const { return Cbegin(); }
+  [[nodiscard]] const_iterator end() const { return Cend(); }
+  [[nodiscard]] size_t size() const { return size_; }
+
   value_type& Front();
   [[nodiscard]] const value_type& Front() const;
   value_type& Back();
@@ -61,21 +342,523 @@ class List {
   void PopBack();
   void PopFront();
 
+  // Inserts before pos and returns an iterator to the new element.
+  template <typename... Args>
+  iterator Emplace(const_iterator pos, Args&&... args);
+
+  template <typename U>
+  iterator Insert(const_iterator pos, U&& value);
+
+  // Builds the new nodes off-list and links them before pos in one step, so
+  // if copying an element throws the list is left unchanged. Returns an
+  // iterator to the first inserted element, or pos if the range is empty.
+  template <typename InputIt>
+  iterator InsertRange(const_iterator pos, InputIt first, InputIt last);
+
+  // Erase returns an iterator to the element after the erased ones. A range
+  // is unlinked in O(1), then its nodes are destroyed and released in a
+  // single pass.
+  iterator Erase(const_iterator pos);
+  iterator Erase(const_iterator first, const_iterator last);
+
+  // Replace the contents by assigning into the existing nodes; only the
+  // missing nodes are allocated and only the surplus ones are released.
+  // Missing nodes are built first, so a throwing copy constructor leaves the
+  // list unchanged; if T's copy assignment throws, the list keeps its size
+  // with a prefix of elements already assigned. Copy assignment uses the
+  // same path unless the allocator has to be replaced.
+  void Assign(size_t count, const T& value);
+
+  template <typename InputIt,
+            typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  void Assign(InputIt first, InputIt last);
+
+  // Node cache: popped nodes are kept for reuse by later emplaces instead of
+  // being returned to the allocator. Disabled (limit 0) by default.
+  void SetNodeCacheLimit(size_t limit);
+  [[nodiscard]] size_t NodeCacheLimit() const { return node_cache_limit_; }
+  [[nodiscard]] size_t CachedNodes() const { return free_count_; }
+
+  // Makes sure that at least count nodes are cached, raising the limit if
+  // needed, so that the next count emplaces do not touch the allocator.
+  void ReserveNodes(size_t count);
+
+  // Returns all cached nodes to the allocator.
+  void ShrinkToFit();
+
+  // Detaches every node, the node cache included, in O(1) and hands them to
+  // the reclaimer (see SetReclaimer, ListReclaimer::Default() if none), which
+  // destroys and deallocates them later; the list is empty and usable right
+  // away. The allocator has to be usable from the reclaimer's thread.
+  void ClearAsync();
+
+  // Opt-in deferred destruction: with a reclaimer set, the destructor of a
+  // list of at least kDeferredDestroyMinSize elements goes through
+  // ClearAsync. nullptr (the default) destroys in place. The reclaimer must
+  // outlive the list.
+  static constexpr size_t kDeferredDestroyMinSize = 1 << 12;
+
+  void SetReclaimer(ListReclaimer* reclaimer) { reclaimer_ = reclaimer; }
+  [[nodiscard]] ListReclaimer* Reclaimer() const { return reclaimer_; }
+
+  // Moves the elements (move_if_noexcept) into one freshly allocated slab in
+  // list order, so that traversal walks memory sequentially, and frees the
+  // old nodes. Iterators are invalidated. The old slabs are released as
+  // well. If a copy throws, the elements relocated so far stay in the new
+  // slab and the list keeps all of its values.
+  void Compact();
+
+  // Incremental Compact: relocates at most max_nodes nodes per call,
+  // continuing where the previous call stopped. The slab for the whole pass
+  // is allocated by the first call. Returns true when the pass has reached
+  // the end of the list; the next call starts a new pass. Elements added
+  // during a pass are not guaranteed to be relocated. If every element ended
+  // up in the slab of the pass, the old slabs are released as by Compact, so
+  // repeated passes keep memory bounded.
+  bool CompactStep(size_t max_nodes);
+
+  // Moves the nodes of other (all of them, the one at it, or [first, last))
+  // before pos without copying elements. The allocators of both lists must
+  // compare equal. Everything is O(1) except splicing a range from another
+  // list, which has to count its length, and taking nodes from a list with
+  // slabs, which merges its slabs into ours in O(number of slabs) and may
+  // allocate the table for them. Throws before moving anything.
+  void Splice(const_iterator pos, List& other);
+  void Splice(const_iterator pos, List& other, const_iterator it);
+  void Splice(const_iterator pos, List& other, const_iterator first,
+              const_iterator last);
+
+  // Merges sorted other into this sorted list, leaving other empty. Stable:
+  // of equivalent elements, the ones from *this go first.
+  template <typename Compare = std::less<T>>
+  void Merge(List& other, Compare comp = Compare());
+
+  // Stable merge sort which only relinks nodes. If comp throws, the list keeps
+  // all of its elements in an unspecified order.
+  template <typename Compare = std::less<T>>
+  void Sort(Compare comp = Compare());
+
+  // Lists shorter than this are sorted by ParallelSort on the calling thread.
+  static constexpr size_t kParallelSortCutoff = 1 << 17;
+
+  // Sort for very long lists: the chain is cut into threads pieces which are
+  // sorted concurrently and then merged pairwise, also concurrently, by the
+  // same threads. Gives the same result as Sort. threads == 0 means
+  // hardware_concurrency; comp is copied for every piece and every merge. No
+  // nodes are allocated.
+  template <typename Compare = std::less<T>>
+  void ParallelSort(Compare comp = Compare(), size_t threads = 0,
+                    size_t sequential_cutoff = kParallelSortCutoff);
+
+  // Prefetching is off by default: the cursor running ahead has to chase the
+  // same pointers, so on a scattered list it waits for the same misses (see
+  // list_bench). It can pay off where the hardware overlaps those loads.
+  static constexpr size_t kPrefetchDistance = 0;
+
+  // Bulk traversal in a tight loop over the nodes instead of the iterator.
+  // With prefetch_distance > 0 a second cursor runs that many nodes ahead
+  // and prefetches them.
+  template <typename F>
+  void ForEach(F f, size_t prefetch_distance = kPrefetchDistance);
+
+  template <typename F>
+  void ForEach(F f, size_t prefetch_distance = kPrefetchDistance) const;
+
+  template <typename U, typename BinaryOp = std::plus<>>
+  U Accumulate(U init, BinaryOp op = BinaryOp(),
+               size_t prefetch_distance = kPrefetchDistance) const;
+
+  // Returns End() if no element satisfies pred.
+  template <typename Pred>
+  iterator FindIf(Pred pred, size_t prefetch_distance = kPrefetchDistance) const;
+
+  // Visits the elements in unspecified order.
+  template <typename Pred>
+  size_t CountIf(Pred pred) const;
+
+  // With an automatic thread count, segments are kept at least this long.
+  static constexpr size_t kParallelMinSegment = 1 << 14;
+
+  // Split points of the list into parts segments of (almost) equal length.
+  class Segments;
+
+  // Finds the split points with one pass, walked from both ends at once on
+  // long lists. parts == 0 means hardware_concurrency, but no more than
+  // Size() / kParallelMinSegment. The result stays valid until the list is
+  // modified and can be reused to skip the pass on repeated calls.
+  [[nodiscard]] Segments Split(size_t parts = 0) const;
+
+  // Parallel algorithms: every segment is processed on a thread of its own
+  // (see Split for threads). The list must not be modified, nor its
+  // elements accessed by other threads, until they return. f, op and
+  // transform are copied to every thread; op has to be associative, but
+  // partial results are combined in list order, so it need not commute.
+  // The first exception thrown by a segment is rethrown.
+  template <typename F>
+  void ParallelForEach(F f, size_t threads = 0);
+
+  template <typename F>
+  void ParallelForEach(F f, const Segments& segments);
+
+  template <typename F>
+  void ParallelForEach(F f, size_t threads = 0) const;
+
+  template <typename F>
+  void ParallelForEach(F f, const Segments& segments) const;
+
+  template <typename U, typename BinaryOp = std::plus<>>
+  U ParallelReduce(U init, BinaryOp op = BinaryOp(), size_t threads = 0) const;
+
+  template <typename U, typename BinaryOp>
+  U ParallelReduce(U init, BinaryOp op, const Segments& segments) const;
+
+  template <typename U, typename ReduceOp, typename TransformOp>
+  U ParallelTransformReduce(U init, ReduceOp reduce, TransformOp transform,
+                            size_t threads = 0) const;
+
+  template <typename U, typename ReduceOp, typename TransformOp>
+  U ParallelTransformReduce(U init, ReduceOp reduce, TransformOp transform,
+                            const Segments& segments) const;
+
+  // Optional positional index: every stride-th node and its position. It is
+  // built by the first query and patched by EmplaceBack/EmplaceFront and
+  // PopBack/PopFront; any other structural change drops it, and the next
+  // non-const query builds it again. With the index At, Advance and
+  // Distance cost O(Size() / stride + stride), without it they walk. Only
+  // the non-const overloads build the index; the const ones use it if it is
+  // there and walk otherwise, so const queries never write to the list and
+  // may run concurrently. stride == 0 (the default) frees it.
+  void SetPositionIndexStride(size_t stride);
+  [[nodiscard]] size_t PositionIndexStride() const { return index_.stride; }
+
+  // Bytes the index has taken from the allocator.
+  [[nodiscard]] size_t PositionIndexBytes() const { return index_.bytes; }
+
+  // The element at position i < Size().
+  T& At(size_t i);
+  [[nodiscard]] const T& At(size_t i) const;
+
+  // it moved by k positions; the result must be within [Begin(), End()].
+  [[nodiscard]] iterator Advance(const_iterator it, std::ptrdiff_t k);
+  [[nodiscard]] iterator Advance(const_iterator it, std::ptrdiff_t k) const;
+
+  // The number of positions from first to last.
+  [[nodiscard]] std::ptrdiff_t Distance(const_iterator first,
+                                        const_iterator last);
+  [[nodiscard]] std::ptrdiff_t Distance(const_iterator first,
+                                        const_iterator last) const;
+
+  // Binary snapshot for trivially copyable T: a header (magic, sizeof(T),
+  // element count) followed by the raw elements in list order, in native
+  // byte order. Elements are written and read in blocks of
+  // kSerialBlockBytes; Deserialize builds the list in a single slab. Errors
+  // throw std::runtime_error (std::system_error for file descriptors); a
+  // failed Deserialize leaks nothing.
+  static constexpr size_t kSerialBlockBytes = 1 << 16;
+
+  void SerializeTo(std::ostream& out) const;
+
+  static List Deserialize(std::istream& in,
+                          const Allocator& alloc = Allocator());
+
+#if LIST_POSIX_IO
+  void SerializeTo(int fd) const;
+
+  static List Deserialize(int fd, const Allocator& alloc = Allocator());
+#endif
+
+  // Streaming Deserialize for snapshots that do not fit in memory: reads the
+  // header once, then every Next(max_count) loads the following elements
+  // into a list of their own.
+  class Reader;
+
+  // Snapshot of the instrumentation counters, see LIST_ENABLE_STATS.
+  [[nodiscard]] ListStats Stats() const;
+
   private:
+  struct NodeBase;
   struct Node;
-  Node* head_;
-  Node* tail_;
-  Node* x_;
+  struct Slab;
+  // The nodes of a list handed to a ListReclaimer.
+  struct Detached;
+  Node* head_ = nullptr;
+  Node* tail_ = nullptr;
+  // The sentinel only has links, so it lives in the list object itself and
+  // an empty list owns no memory.
+  mutable NodeBase x_{&x_, &x_};
   size_t size_ = 0;
 
+  Node* free_nodes_ = nullptr;
+  size_t free_count_ = 0;
+  size_t node_cache_limit_ = 0;
+
+  // Contiguous blocks of nodes allocated by FillList. Their nodes can not be
+  // returned to the allocator one by one, so popped slab nodes go to
+  // slab_free_ and the blocks themselves are freed when the last list
+  // referring to them lets go, see Slab. slabs_ holds slab_count_ slabs this
+  // list refers to, sorted by address so that OwnedBySlab is a binary search.
+  Slab** slabs_ = nullptr;
+  size_t slab_count_ = 0;
+  size_t slab_capacity_ = 0;
+  Node* slab_free_ = nullptr;
+
+  // State of the CompactStep pass: the next node to relocate (nullptr when
+  // there is no pass) and the unused part of its slab. Nodes relocated so
+  // far are [compact_slab_, compact_slots_), compact_live_ of them hold
+  // elements; when that is all of them at the end of the pass, the old
+  // slabs are freed.
+  NodeBase* compact_next_ = nullptr;
+  Node* compact_slots_ = nullptr;
+  size_t compact_left_ = 0;
+  Node* compact_slab_ = nullptr;
+  size_t compact_live_ = 0;
+
+  // nodes[first + j] is at position j * stride + shift and has sequence
+  // number first_seq + j in seq, which maps indexed nodes back to
+  // positions. nodes keeps free room at the front for EmplaceFront.
+  // Both containers allocate through IndexAllocator, which adds what they
+  // take to bytes, so PositionIndexBytes does not have to guess how the
+  // standard library lays out its nodes.
+  template <typename U>
+  struct IndexAllocator {
+    using value_type = U;
+
+    explicit IndexAllocator(size_t* bytes) : bytes(bytes) {}
+    template <typename V>
+    IndexAllocator(const IndexAllocator<V>& other) : bytes(other.bytes) {}
+
+    U* allocate(size_t n) {
+      U* p = std::allocator<U>().allocate(n);
+      *bytes += n * sizeof(U);
+      return p;
+    }
+    void deallocate(U* p, size_t n) {
+      *bytes -= n * sizeof(U);
+      std::allocator<U>().deallocate(p, n);
+    }
+
+    bool operator==(const IndexAllocator& other) const {
+      return bytes == other.bytes;
+    }
+    bool operator!=(const IndexAllocator& other) const {
+      return bytes != other.bytes;
+    }
+
+    size_t* bytes;
+  };
+
+  struct PositionIndex {
+    using node_vector = std::vector<NodeBase*, IndexAllocator<NodeBase*>>;
+    using seq_map = std::unordered_map<
+        const NodeBase*, int64_t, std::hash<const NodeBase*>,
+        std::equal_to<const NodeBase*>,
+        IndexAllocator<std::pair<const NodeBase* const, int64_t>>>;
+
+    PositionIndex() = default;
+    // The containers point at bytes.
+    PositionIndex(const PositionIndex&) = delete;
+    PositionIndex& operator=(const PositionIndex&) = delete;
+
+    size_t bytes = 0;
+    node_vector nodes{IndexAllocator<NodeBase*>(&bytes)};
+    seq_map seq{typename seq_map::allocator_type(&bytes)};
+    size_t first = 0;
+    int64_t first_seq = 0;
+    size_t shift = 0;
+    size_t stride = 0;
+    bool built = false;
+
+    [[nodiscard]] size_t Count() const { return nodes.size() - first; }
+  };
+  PositionIndex index_;
+
+  // Upper bound on the number of nodes outside slabs. Nodes spliced in from
+  // another list are counted here without being taken off there. When it is
+  // 0 the destructor does not have to look for nodes to deallocate.
+  size_t heap_nodes_ = 0;
+
+  ListReclaimer* reclaimer_ = nullptr;
+
   using alloc_traits = typename std::allocator_traits<
       allocator_type>::template rebind_traits<Node>;
   using alloc_type = typename std::allocator_traits<
       allocator_type>::template rebind_alloc<Node>;
+  using slab_alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Slab>;
+  using slab_alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Slab>;
+  using slab_ref_alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Slab*>;
+  using slab_ref_alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Slab*>;
   alloc_type alloc_;
 
+  // Destroying a node does nothing, so teardown only has to free memory.
+  static constexpr bool kTrivialTeardown =
+      std::is_trivially_destructible_v<T> &&
+      std::is_same_v<alloc_type, std::allocator<Node>>;
+
+#if LIST_ENABLE_STATS
+  ListStats stats_;
+#endif
+
+  // Instrumentation hooks, empty unless LIST_ENABLE_STATS.
+  void CountNodeAllocations([[maybe_unused]] size_t count) {
+#if LIST_ENABLE_STATS
+    stats_.node_allocations += count;
+#endif
+  }
+
+  void CountNodeDeallocations([[maybe_unused]] size_t count) {
+#if LIST_ENABLE_STATS
+    stats_.node_deallocations += count;
+#endif
+  }
+
+  void CountMakeNode() {
+#if LIST_ENABLE_STATS
+    ++stats_.make_node_calls;
+#endif
+  }
+
+  void CountCleanList([[maybe_unused]] size_t nodes) {
+#if LIST_ENABLE_STATS
+    ++stats_.clean_list_calls;
+    stats_.cleaned_nodes += nodes;
+#endif
+  }
+
+  void CountSlabAllocation() {
+#if LIST_ENABLE_STATS
+    ++stats_.slab_allocations;
+#endif
+  }
+
+  void CountGrowth() {
+#if LIST_ENABLE_STATS
+    stats_.peak_size = std::max(stats_.peak_size, size_);
+#endif
+  }
+
+  static Node* AsNode(NodeBase* node) { return static_cast<Node*>(node); }
+
   void SetEnds();
 
+  // Recomputes head_ and tail_ from the sentinel after nodes were relinked.
+  void ResetEnds();
+
+  // Exchanges everything but the allocators and the node caches.
+  void SwapNodes(List& other) noexcept;
+
+  void SwapCaches(List& other) noexcept;
+
+  static void Unlink(NodeBase* first, NodeBase* last);
+
+  static void LinkBefore(NodeBase* position, NodeBase* first, NodeBase* last);
+
+  static NodeBase* ConcatChains(NodeBase* left, NodeBase* right);
+
+  template <typename Compare>
+  static NodeBase* MergeChains(NodeBase*& left, NodeBase*& right,
+                               Compare& comp);
+
+  template <typename Compare>
+  static void SortChain(NodeBase*& head, Compare& comp);
+
+  void LinkChain(NodeBase* head);
+
+  template <typename Task>
+  static std::exception_ptr RunParallel(size_t tasks, Task& task);
+
+  static void Prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#endif
+  }
+
+  void BuildIndex();
+
+  void DropIndex();
+
+  void IndexPushBack(NodeBase* node);
+
+  void IndexPushFront(NodeBase* node);
+
+  void IndexPopBack(NodeBase* node);
+
+  void IndexPopFront(NodeBase* node);
+
+  [[nodiscard]] size_t PositionOf(const NodeBase* node) const;
+
+  [[nodiscard]] NodeBase* NodeAt(size_t position) const;
+
+  // Calls visit(node) for every node in order until it returns false and
+  // returns the node it stopped at (or the sentinel).
+  template <typename Visit>
+  NodeBase* Walk(Visit& visit, size_t prefetch_distance) const;
+
+  Node* AllocateNode();
+
+  void ReleaseNode(Node* node);
+
+  // Destroys and releases the detached chain first..last (inclusive) and
+  // returns the number of nodes in it.
+  size_t ReleaseChain(NodeBase* first, NodeBase* last);
+
+  // Appends node to the detached chain head..tail.
+  static void AppendToChain(Node*& head, Node*& tail, Node* node);
+
+  // Builds a detached chain of copies of [first, last). Nothing is leaked if
+  // a copy throws. Returns the number of nodes.
+  template <typename InputIt>
+  size_t BuildChain(InputIt first, InputIt last, Node*& head, Node*& tail);
+
+  // Links the detached chain at the end if there is one, otherwise erases
+  // everything from node on.
+  void FinishAssign(NodeBase* node, Node* head, Node* tail, size_t count);
+
+  template <typename InputIt>
+  void AssignRange(InputIt first, InputIt last, std::input_iterator_tag);
+
+  template <typename ForwardIt>
+  void AssignRange(ForwardIt first, ForwardIt last,
+                   std::forward_iterator_tag);
+
+  Node* AllocateSlab(size_t count);
+
+  // Destroys the first constructed nodes of the slab at nodes and releases
+  // every slab.
+  void DropSlab(Node* nodes, size_t constructed);
+
+  // Adds the slabs of other this list does not refer to yet. Called before
+  // taking nodes from other, so throwing leaves both lists untouched.
+  void AdoptSlabs(const List& other);
+
+  void MergeSlabs(Slab* const* theirs, size_t count);
+
+  void ReleaseSlab(Slab* slab);
+
+  void ReleaseSlabs();
+
+  [[nodiscard]] bool OwnedBySlab(const Node* node) const;
+
+  void LinkSlab(Node* nodes, size_t count);
+
+  // Relocates up to count nodes starting at next into slots, replacing them
+  // in the chain; next and used follow the progress even if a copy throws.
+  void Relocate(NodeBase*& next, Node* slots, size_t count, size_t& used);
+
+  // Returns the unused slots of the CompactStep pass to slab_free_.
+  void EndCompactPass();
+
+  // Releases every slab but the one starting at keep.
+  void FreeOldSlabs(const Node* keep);
+
+  [[nodiscard]] bool RelocatedThisPass(const Node* node) const {
+    std::less<const Node*> less;
+    return !less(node, compact_slab_) && less(node, compact_slots_);
+  }
+
   Node* MakeNode();
 
   Node* MakeNode(value_type& value);
@@ -93,129 +876,364 @@ class List {
 
   void FillList(std::initializer_list<T> init_list);
 
-  void CleanList(Node* current, Node* next_node, bool dealloc = true);
+  void CleanList(NodeBase* current, NodeBase* next_node, bool dealloc = true);
+
+  // Moves the contents into a Detached and submits it; false if they have to
+  // be destroyed here instead.
+  bool DeferClear() noexcept;
+
+  struct SerialHeader {
+    uint32_t magic;
+    uint32_t element_size;
+    uint64_t count;
+  };
+
+  static constexpr uint32_t kSerialMagic = 0x3154534c;  // "LST1"
+
+  static constexpr size_t kSerialBlockElements =
+      sizeof(T) < kSerialBlockBytes ? kSerialBlockBytes / sizeof(T) : 1;
+
+  static void WriteBytes(std::ostream& out, const void* data, size_t bytes);
+
+  static void ReadBytes(std::istream& in, void* data, size_t bytes);
+
+#if LIST_POSIX_IO
+  static void WriteBytes(int fd, const void* data, size_t bytes);
+
+  static void ReadBytes(int fd, void* data, size_t bytes);
+#endif
+
+  template <typename Sink>
+  void WriteSnapshot(Sink& sink) const;
+
+  // Returns the element count after checking the header.
+  template <typename Source>
+  static size_t ReadHeader(Source& source);
+
+  // Fills an empty list with count elements from source, all in one slab.
+  template <typename Source>
+  void ReadNodes(Source& source, size_t count);
+};
+
+template <typename T, typename Allocator>
+class List<T, Allocator>::Segments {
+  friend class List<T, Allocator>;
+
+  public:
+  [[nodiscard]] size_t Count() const { return bounds_.size() - 1; }
+
+  private:
+  // Segment i is [bounds_[i], bounds_[i + 1]); the last bound is the
+  // sentinel.
+  std::vector<NodeBase*> bounds_;
+};
+
+template <typename T, typename Allocator>
+class List<T, Allocator>::Reader {
+  public:
+  explicit Reader(std::istream& in) : in_(&in), remaining_(ReadHeader(in)) {}
+
+#if LIST_POSIX_IO
+  explicit Reader(int fd) : fd_(fd), remaining_(ReadHeader(fd)) {}
+#endif
+
+  [[nodiscard]] size_t Remaining() const { return remaining_; }
+
+  // Returns the next min(max_count, Remaining()) elements.
+  List Next(size_t max_count, const Allocator& alloc = Allocator()) {
+    List chunk(alloc);
+    size_t count = std::min(max_count, remaining_);
+    if (in_ != nullptr) {
+      chunk.ReadNodes(*in_, count);
+    }
+#if LIST_POSIX_IO
+    else {
+      chunk.ReadNodes(fd_, count);
+    }
+#endif
+    remaining_ -= count;
+    return chunk;
+  }
+
+  private:
+  std::istream* in_ = nullptr;
+  int fd_ = -1;
+  size_t remaining_;
 };
 
 template <typename T, typename Allocator>
 template <bool is_const>
-class List<T, Allocator>::ListIterator
-    : public std::iterator<std::bidirectional_iterator_tag, T> {
+class List<T, Allocator>::ListIterator {
   friend class List<T, Allocator>;
 
   public:
-  using node = std::conditional_t<is_const, const Node, Node>;
-  using value_type = List<T, Allocator>::value_type;
-  using ptr =
-      std::conditional_t<is_const, const List<T, Allocator>::value_type*,
-                         List<T, Allocator>::value_type*>;
-  using ref =
-      std::conditional_t<is_const, const List<T, Allocator>::value_type&,
-                         List<T, Allocator>::value_type&>;
+  using node = std::conditional_t<is_const, const NodeBase, NodeBase>;
+  using value_node = std::conditional_t<is_const, const Node, Node>;
 
   using iterator_category = std::bidirectional_iterator_tag;
-  explicit ListIterator(node* node_p) : node_p_(node_p){};
-  ListIterator(const ListIterator<is_const>& it) : node_p_(it.node_p_) {}
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const T*, T*>;
+  using reference = std::conditional_t<is_const, const T&, T&>;
+
+  ListIterator() = default;
+
+  explicit ListIterator(node* node_p) : node_p_(node_p) {}
 
-  value_type operator*() const { return node_p_->value; }
+  // iterator converts to const_iterator.
+  template <bool other_const,
+            typename = std::enable_if_t<is_const && !other_const>>
+  ListIterator(const ListIterator<other_const>& it) : node_p_(it.node_p_) {}
 
-  ref operator*() { return node_p_->value; }
+  reference operator*() const {
+    return static_cast<value_node*>(node_p_)->value;
+  }
 
-  ptr operator->() const { return &(node_p_->value); }
+  pointer operator->() const { return &**this; }
 
   ListIterator& operator++() {
     node_p_ = node_p_->next;
     return *this;
   }
 
+  ListIterator operator++(int) {
+    ListIterator old = *this;
+    node_p_ = node_p_->next;
+    return old;
+  }
+
   ListIterator& operator--() {
     node_p_ = node_p_->prev;
     return *this;
   }
 
-  bool operator==(const ListIterator& other) {
-    return node_p_ == other.node_p_;
+  ListIterator operator--(int) {
+    ListIterator old = *this;
+    node_p_ = node_p_->prev;
+    return old;
+  }
+
+  // Hidden friends, so that iterator and const_iterator compare with each
+  // other through the conversion.
+  friend bool operator==(const ListIterator& lhs, const ListIterator& rhs) {
+    return lhs.node_p_ == rhs.node_p_;
   }
 
-  bool operator!=(const ListIterator& other) {
-    return node_p_ != other.node_p_;
+  friend bool operator!=(const ListIterator& lhs, const ListIterator& rhs) {
+    return lhs.node_p_ != rhs.node_p_;
   }
 
   private:
-  node* node_p_;
+  friend class ListIterator<!is_const>;
+
+  node* node_p_ = nullptr;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 template <typename T, typename Allocator>
-struct List<T, Allocator>::Node {
+struct List<T, Allocator>::NodeBase {
+  NodeBase* next = nullptr;
+  NodeBase* prev = nullptr;
+};
+
+template <typename T, typename Allocator>
+struct List<T, Allocator>::Node : NodeBase {
   Node() = default;
 
-  Node(const Node& other)
-      : next(other.next), prev(other.prev), value(other.value) {}
+  Node(const Node& other) : NodeBase(other), value(other.value) {}
 
   explicit Node(const T& value) : value(value){};
 
   explicit Node(T&& value) : value(std::move(value)) {}
 
-  Node(Node&& other) noexcept
-      : next(other.next), prev(other.prev), value(std::move(other.value)) {
-    next = nullptr;
-    prev = nullptr;
-  }
+  Node(Node&& other) noexcept : value(std::move(other.value)) {}
 
   template <typename... Args>
-  explicit Node(Node* fictive, Args&&... args)
-      : next(fictive), value(std::forward<Args>(args)...) {}
+  explicit Node(NodeBase* fictive, Args&&... args)
+      : NodeBase{fictive, nullptr}, value(std::forward<Args>(args)...) {}
 
   ~Node() = default;
 
-  Node* next = nullptr;
-  Node* prev = nullptr;
   T value;
 };
 
+// Slabs are shared by all lists that exchanged nodes through Splice or Merge:
+// a node of one list may live in a slab allocated by another. Every list
+// keeps its own table of the slabs it refers to and only the reference count
+// is shared, so lists sharing slabs may still be used and destroyed on
+// different threads. The slab is freed by whoever drops the last reference.
 template <typename T, typename Allocator>
-void List<T, Allocator>::SetEnds() {
-  head_->prev = x_;
-  tail_->next = x_;
-  x_->next = head_;
-  x_->prev = tail_;
-}
+struct List<T, Allocator>::Slab {
+  Node* nodes;
+  size_t count;
+  std::atomic<size_t> refs;
+};
 
 template <typename T, typename Allocator>
-typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode(
-    const List::Node& other) {
-  Node* new_node = alloc_traits::allocate(alloc_, 1);
-  try {
-    alloc_traits::construct(alloc_, new_node, other);
-  } catch (...) {
-    alloc_traits::deallocate(alloc_, new_node, 1);
-    throw;
+struct List<T, Allocator>::Detached : ListReclaimer::Garbage {
+  explicit Detached(List&& other) : list(std::move(other)) {
+    list.reclaimer_ = nullptr;
   }
-  return new_node;
-}
+
+  List list;
+};
 
 template <typename T, typename Allocator>
-typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode(
-    value_type& value) {
-  Node* new_node = alloc_traits::allocate(alloc_, 1);
-  try {
-    alloc_traits::construct(alloc_, new_node, value);
-  } catch (...) {
-    alloc_traits::deallocate(alloc_, new_node, 1);
-    throw;
+void List<T, Allocator>::SetEnds() {
+  if (Empty()) {
+    x_.next = &x_;
+    x_.prev = &x_;
+    return;
   }
-  return new_node;
+  head_->prev = &x_;
+  tail_->next = &x_;
+  x_.next = head_;
+  x_.prev = tail_;
 }
 
 template <typename T, typename Allocator>
-typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode() {
-  Node* new_node = alloc_traits::allocate(alloc_, 1);
-  try {
-    alloc_traits::construct(alloc_, new_node);
-  } catch (...) {
-    alloc_traits::deallocate(alloc_, new_node, 1);
-    throw;
+void List<T, Allocator>::ResetEnds() {
+  if (Empty()) {
+    DropIndex();
+    head_ = nullptr;
+    tail_ = nullptr;
+    x_.next = &x_;
+    x_.prev = &x_;
+    return;
+  }
+  head_ = AsNode(x_.next);
+  tail_ = AsNode(x_.prev);
+  DropIndex();
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::SwapCaches(List& other) noexcept {
+  std::swap(free_nodes_, other.free_nodes_);
+  std::swap(free_count_, other.free_count_);
+  std::swap(node_cache_limit_, other.node_cache_limit_);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::SwapNodes(List& other) noexcept {
+  std::swap(size_, other.size_);
+  std::swap(head_, other.head_);
+  std::swap(tail_, other.tail_);
+  std::swap(slabs_, other.slabs_);
+  std::swap(slab_count_, other.slab_count_);
+  std::swap(slab_capacity_, other.slab_capacity_);
+  std::swap(slab_free_, other.slab_free_);
+  std::swap(compact_next_, other.compact_next_);
+  std::swap(compact_slots_, other.compact_slots_);
+  std::swap(compact_left_, other.compact_left_);
+  std::swap(compact_slab_, other.compact_slab_);
+  std::swap(compact_live_, other.compact_live_);
+  std::swap(heap_nodes_, other.heap_nodes_);
+  DropIndex();
+  other.DropIndex();
+  SetEnds();
+  other.SetEnds();
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Node* List<T, Allocator>::AllocateNode() {
+  if (slab_free_ != nullptr) {
+    Node* node = slab_free_;
+    slab_free_ = AsNode(node->next);
+    if (compact_slab_ != nullptr && RelocatedThisPass(node)) {
+      ++compact_live_;
+    }
+    return node;
+  }
+  if (free_nodes_ == nullptr) {
+    Node* node = alloc_traits::allocate(alloc_, 1);
+    CountNodeAllocations(1);
+    ++heap_nodes_;
+    return node;
+  }
+  Node* node = free_nodes_;
+  free_nodes_ = AsNode(node->next);
+  --free_count_;
+  ++heap_nodes_;
+  return node;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReleaseNode(List::Node* node) {
+  if (node == compact_next_) {
+    // The released node is already unlinked but still points to its successor.
+    compact_next_ = node->next;
+  }
+  if (compact_slab_ != nullptr && RelocatedThisPass(node)) {
+    --compact_live_;
+  }
+  if (slab_count_ != 0 && OwnedBySlab(node)) {
+    node->next = slab_free_;
+    slab_free_ = node;
+    return;
+  }
+  --heap_nodes_;
+  if (free_count_ >= node_cache_limit_) {
+    alloc_traits::deallocate(alloc_, node, 1);
+    CountNodeDeallocations(1);
+    return;
+  }
+  node->next = free_nodes_;
+  free_nodes_ = node;
+  ++free_count_;
+}
+
+template <typename T, typename Allocator>
+size_t List<T, Allocator>::ReleaseChain(NodeBase* first, NodeBase* last) {
+  size_t count = 0;
+  NodeBase* end = last->next;
+  while (first != end) {
+    NodeBase* next = first->next;
+    alloc_traits::destroy(alloc_, AsNode(first));
+    ReleaseNode(AsNode(first));
+    first = next;
+    ++count;
+  }
+  return count;
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode(
+    const List::Node& other) {
+  CountMakeNode();
+  Node* new_node = AllocateNode();
+  try {
+    alloc_traits::construct(alloc_, new_node, other);
+  } catch (...) {
+    ReleaseNode(new_node);
+    throw;
+  }
+  return new_node;
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode(
+    value_type& value) {
+  CountMakeNode();
+  Node* new_node = AllocateNode();
+  try {
+    alloc_traits::construct(alloc_, new_node, value);
+  } catch (...) {
+    ReleaseNode(new_node);
+    throw;
+  }
+  return new_node;
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode() {
+  CountMakeNode();
+  Node* new_node = AllocateNode();
+  try {
+    alloc_traits::construct(alloc_, new_node);
+  } catch (...) {
+    ReleaseNode(new_node);
+    throw;
   }
   return new_node;
 }
@@ -224,18 +1242,19 @@ template <typename T, typename Allocator>
 template <typename... Args>
 typename List<T, Allocator>::Node* List<T, Allocator>::MakeNode(
     Args&&... args) {
-  Node* new_node = alloc_traits::allocate(alloc_, 1);
+  CountMakeNode();
+  Node* new_node = AllocateNode();
   try {
     alloc_traits::construct(alloc_, new_node, std::forward<Args>(args)...);
   } catch (...) {
-    alloc_traits::deallocate(alloc_, new_node, 1);
+    ReleaseNode(new_node);
     throw;
   }
   return new_node;
 }
 
 template <typename T, typename Allocator>
-void List<T, Allocator>::CleanList(List::Node* current, List::Node* next_node,
+void List<T, Allocator>::CleanList(NodeBase* current, NodeBase* next_node,
                                    bool dealloc) {
   if (Empty()) {
     return;
@@ -243,118 +1262,269 @@ void List<T, Allocator>::CleanList(List::Node* current, List::Node* next_node,
   if (current == next_node) {
     current = current->prev;
   }
-  while (next_node != x_) {
-    alloc_traits::destroy(alloc_, next_node);
-    if (dealloc) {
-      alloc_traits::deallocate(alloc_, next_node, 1);
+  // Slab nodes are freed a block at a time with their slab.
+  bool heap = dealloc && heap_nodes_ != 0;
+  if (kTrivialTeardown && !heap) {
+    CountCleanList(size_);
+    return;
+  }
+  size_t cleaned = 0;
+  size_t deallocated = 0;
+  while (next_node != &x_) {
+    if constexpr (!kTrivialTeardown) {
+      alloc_traits::destroy(alloc_, AsNode(next_node));
+    }
+    if (heap && !OwnedBySlab(AsNode(next_node))) {
+      alloc_traits::deallocate(alloc_, AsNode(next_node), 1);
+      ++deallocated;
     }
+    ++cleaned;
     next_node = current;
     current = current->prev;
   }
+  CountCleanList(cleaned);
+  CountNodeDeallocations(deallocated);
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Node* List<T, Allocator>::AllocateSlab(
+    size_t count) {
+  slab_alloc_type slab_alloc(alloc_);
+  Slab* slab = slab_alloc_traits::allocate(slab_alloc, 1);
+  Node* nodes;
+  try {
+    nodes = alloc_traits::allocate(alloc_, count);
+  } catch (...) {
+    slab_alloc_traits::deallocate(slab_alloc, slab, 1);
+    throw;
+  }
+  ::new (static_cast<void*>(slab)) Slab{nodes, count, 0};
+  try {
+    MergeSlabs(&slab, 1);
+  } catch (...) {
+    alloc_traits::deallocate(alloc_, nodes, count);
+    slab_alloc_traits::deallocate(slab_alloc, slab, 1);
+    throw;
+  }
+  CountSlabAllocation();
+  return nodes;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::DropSlab(List::Node* nodes, size_t constructed) {
+  while (constructed > 0) {
+    --constructed;
+    alloc_traits::destroy(alloc_, nodes + constructed);
+  }
+  ReleaseSlabs();
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::AdoptSlabs(const List& other) {
+  if (&other != this) {
+    MergeSlabs(other.slabs_, other.slab_count_);
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::MergeSlabs(Slab* const* theirs, size_t count) {
+  std::less<const Node*> less;
+  size_t added = 0;
+  for (size_t i = 0, j = 0; j < count;) {
+    if (i == slab_count_ || less(theirs[j]->nodes, slabs_[i]->nodes)) {
+      ++added;
+      ++j;
+    } else if (less(slabs_[i]->nodes, theirs[j]->nodes)) {
+      ++i;
+    } else {
+      ++i;
+      ++j;
+    }
+  }
+  if (added == 0) {
+    return;
+  }
+  if (slab_count_ + added > slab_capacity_) {
+    slab_ref_alloc_type ref_alloc(alloc_);
+    // Room for a few slabs up front, so that Compact can add its slab
+    // before the old ones are released without growing the table.
+    size_t capacity =
+        std::max({slab_count_ + added, 2 * slab_capacity_, size_t{4}});
+    Slab** table = slab_ref_alloc_traits::allocate(ref_alloc, capacity);
+    std::copy(slabs_, slabs_ + slab_count_, table);
+    if (slabs_ != nullptr) {
+      slab_ref_alloc_traits::deallocate(ref_alloc, slabs_, slab_capacity_);
+    }
+    slabs_ = table;
+    slab_capacity_ = capacity;
+  }
+  // Merges from the back so that the table does not need a second buffer.
+  size_t i = slab_count_;
+  size_t j = count;
+  size_t k = slab_count_ + added;
+  while (j > 0) {
+    if (i > 0 && less(theirs[j - 1]->nodes, slabs_[i - 1]->nodes)) {
+      slabs_[--k] = slabs_[--i];
+    } else if (i > 0 && !less(slabs_[i - 1]->nodes, theirs[j - 1]->nodes)) {
+      slabs_[--k] = slabs_[--i];
+      --j;
+    } else {
+      theirs[j - 1]->refs.fetch_add(1, std::memory_order_relaxed);
+      slabs_[--k] = theirs[--j];
+    }
+  }
+  slab_count_ += added;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReleaseSlab(Slab* slab) {
+  if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  slab_alloc_type slab_alloc(alloc_);
+  alloc_traits::deallocate(alloc_, slab->nodes, slab->count);
+  slab->~Slab();
+  slab_alloc_traits::deallocate(slab_alloc, slab, 1);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReleaseSlabs() {
+  slab_free_ = nullptr;
+  compact_next_ = nullptr;
+  compact_slots_ = nullptr;
+  compact_left_ = 0;
+  compact_slab_ = nullptr;
+  compact_live_ = 0;
+  if (slabs_ == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < slab_count_; ++i) {
+    ReleaseSlab(slabs_[i]);
+  }
+  slab_ref_alloc_type ref_alloc(alloc_);
+  slab_ref_alloc_traits::deallocate(ref_alloc, slabs_, slab_capacity_);
+  slabs_ = nullptr;
+  slab_count_ = 0;
+  slab_capacity_ = 0;
+}
+
+template <typename T, typename Allocator>
+bool List<T, Allocator>::OwnedBySlab(const List::Node* node) const {
+  std::less<const Node*> less;
+  Slab* const* after =
+      std::upper_bound(slabs_, slabs_ + slab_count_, node,
+                       [&less](const Node* node, const Slab* slab) {
+                         return less(node, slab->nodes);
+                       });
+  if (after == slabs_) {
+    return false;
+  }
+  const Slab* slab = after[-1];
+  return less(node, slab->nodes + slab->count);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::LinkSlab(List::Node* nodes, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  for (size_t i = 1; i < count; ++i) {
+    nodes[i - 1].next = nodes + i;
+    nodes[i].prev = nodes + i - 1;
+  }
+  head_ = nodes;
+  tail_ = nodes + count - 1;
+  SetEnds();
+  CountGrowth();
 }
 
 template <typename T, typename Allocator>
 void List<T, Allocator>::FillList(size_t count, value_type value) {
-  Node* current = x_;
-  Node* next_node;
+  if (count == 0) {
+    return;
+  }
+  Node* nodes = AllocateSlab(count);
+  size_t constructed = 0;
   try {
-    for (size_t i = 0; i < count; ++i) {
-      next_node = MakeNode(value);
-      current->next = next_node;
-      next_node->prev = current;
-      current = next_node;
+    for (; constructed < count; ++constructed) {
+      alloc_traits::construct(alloc_, nodes + constructed, value);
     }
   } catch (...) {
-    CleanList(current, next_node);
-    alloc_traits::deallocate(alloc_, x_, 1);
+    DropSlab(nodes, constructed);
     throw;
   }
-  head_ = x_->next;
-  tail_ = next_node;
-  SetEnds();
+  LinkSlab(nodes, count);
 }
 
 template <typename T, typename Allocator>
 void List<T, Allocator>::FillList(size_t count) {
-  Node* current = x_;
-  Node* next_node;
+  if (count == 0) {
+    return;
+  }
+  Node* nodes = AllocateSlab(count);
+  size_t constructed = 0;
   try {
-    for (size_t i = 0; i < count; ++i) {
-      next_node = MakeNode();
-      current->next = next_node;
-      next_node->prev = current;
-      current = next_node;
+    for (; constructed < count; ++constructed) {
+      alloc_traits::construct(alloc_, nodes + constructed);
     }
   } catch (...) {
-    CleanList(current, next_node);
-    alloc_traits::deallocate(alloc_, x_, 1);
+    DropSlab(nodes, constructed);
     throw;
   }
-  head_ = x_->next;
-  tail_ = next_node;
-  SetEnds();
+  LinkSlab(nodes, count);
 }
 
 template <typename T, typename Allocator>
 void List<T, Allocator>::FillList(const List<T, Allocator>& other) {
-  Node* current = x_;
-  Node* next_node;
-  Node* other_current = other.x_;
+  if (other.Empty()) {
+    return;
+  }
+  Node* nodes = AllocateSlab(other.size_);
+  size_t constructed = 0;
   try {
-    while (other_current != other.tail_) {
-      other_current = other_current->next;
-      next_node = MakeNode(*other_current);
-      current->next = next_node;
-      next_node->prev = current;
-      current = next_node;
+    for (Node* other_current = other.head_; other_current != &other.x_;
+         other_current = AsNode(other_current->next)) {
+      alloc_traits::construct(alloc_, nodes + constructed, *other_current);
+      ++constructed;
     }
   } catch (...) {
-    CleanList(current, next_node);
-    alloc_traits::deallocate(alloc_, x_, 1);
+    DropSlab(nodes, constructed);
     throw;
   }
-  head_ = x_->next;
-  tail_ = next_node;
-  SetEnds();
+  LinkSlab(nodes, other.size_);
 }
 
 template <typename T, typename Allocator>
 void List<T, Allocator>::FillList(std::initializer_list<value_type> init_list) {
-  Node* current = x_;
-  Node* next_node;
+  if (init_list.size() == 0) {
+    return;
+  }
+  Node* nodes = AllocateSlab(init_list.size());
+  size_t constructed = 0;
   try {
     for (auto iter = init_list.begin(); iter != init_list.end(); ++iter) {
-      next_node = MakeNode(*iter);
-      current->next = next_node;
-      next_node->prev = current;
-      current = next_node;
+      alloc_traits::construct(alloc_, nodes + constructed, *iter);
+      ++constructed;
     }
   } catch (...) {
-    CleanList(current, next_node);
-    alloc_traits::deallocate(alloc_, x_, 1);
+    DropSlab(nodes, constructed);
     throw;
   }
-  head_ = x_->next;
-  tail_ = next_node;
-  SetEnds();
+  LinkSlab(nodes, init_list.size());
 }
 
 /// -------------------------------Constructors---------------------------------
 
 template <typename T, typename Allocator>
-List<T, Allocator>::List() {
-  x_ = alloc_traits::allocate(alloc_, 1);
-  x_->next = head_;
-  x_->prev = tail_;
-}
+List<T, Allocator>::List() = default;
+
+template <typename T, typename Allocator>
+List<T, Allocator>::List(const Allocator& alloc) : alloc_(alloc) {}
 
 template <typename T, typename Allocator>
 List<T, Allocator>::List(size_t count, const T& value, const Allocator& alloc) {
   size_ = count;
   alloc_ = alloc;
-  x_ = alloc_traits::allocate(alloc_, 1);
-  x_->next = head_;
-  x_->prev = tail_;
   FillList(count, value);
 }
 
@@ -362,18 +1532,12 @@ template <typename T, typename Allocator>
 List<T, Allocator>::List(size_t count, const Allocator& alloc) {
   size_ = count;
   alloc_ = alloc;
-  x_ = alloc_traits::allocate(alloc_, 1);
-  x_->next = head_;
-  x_->prev = tail_;
   FillList(count);
 }
 template <typename T, typename Allocator>
 List<T, Allocator>::List(const List& other) {
   size_ = other.size_;
   alloc_ = alloc_traits::select_on_container_copy_construction(other.alloc_);
-  x_ = alloc_traits::allocate(alloc_, 1);
-  x_->next = head_;
-  x_->prev = tail_;
   FillList(other);
 }
 
@@ -381,17 +1545,44 @@ template <typename T, typename Allocator>
 List<T, Allocator>::List(List&& other) noexcept
     : head_(std::move(other.head_)),
       tail_(std::move(other.tail_)),
-      x_(std::move(other.x_)),
       size_(other.size_),
+      free_nodes_(other.free_nodes_),
+      free_count_(other.free_count_),
+      node_cache_limit_(other.node_cache_limit_),
+      slabs_(other.slabs_),
+      slab_count_(other.slab_count_),
+      slab_capacity_(other.slab_capacity_),
+      slab_free_(other.slab_free_),
+      compact_next_(other.compact_next_),
+      compact_slots_(other.compact_slots_),
+      compact_left_(other.compact_left_),
+      compact_slab_(other.compact_slab_),
+      compact_live_(other.compact_live_),
+      heap_nodes_(other.heap_nodes_),
+      reclaimer_(other.reclaimer_),
       alloc_(std::move(other.alloc_)) {
-  x_->next = head_;
-  x_->prev = tail_;
+#if LIST_ENABLE_STATS
+  stats_ = other.stats_;
+  other.stats_ = ListStats();
+#endif
+  SetEnds();
   other.head_ = nullptr;
   other.tail_ = nullptr;
   other.size_ = 0;
-  other.x_ = alloc_traits::allocate(other.alloc_, 1);
-  other.x_->next = other.head_;
-  other.x_->prev = other.tail_;
+  other.free_nodes_ = nullptr;
+  other.free_count_ = 0;
+  other.slabs_ = nullptr;
+  other.slab_count_ = 0;
+  other.slab_capacity_ = 0;
+  other.slab_free_ = nullptr;
+  other.compact_next_ = nullptr;
+  other.compact_slots_ = nullptr;
+  other.compact_left_ = 0;
+  other.compact_slab_ = nullptr;
+  other.compact_live_ = 0;
+  other.heap_nodes_ = 0;
+  other.DropIndex();
+  other.SetEnds();
 }
 
 template <typename T, typename Allocator>
@@ -399,25 +1590,24 @@ List<T, Allocator>::List(std::initializer_list<value_type> init,
                          const Allocator& alloc) {
   size_ = init.size();
   alloc_ = alloc;
-  x_ = alloc_traits::allocate(alloc_, 1);
-  x_->next = head_;
-  x_->prev = tail_;
   FillList(init);
 }
 
 template <typename T, typename Allocator>
 List<T, Allocator>::~List() {
+  if (reclaimer_ != nullptr && size_ >= kDeferredDestroyMinSize) {
+    DeferClear();
+  }
+  ShrinkToFit();
   if (Empty()) {
-    alloc_traits::deallocate(alloc_, x_, 1);
+    ReleaseSlabs();
     return;
   }
   CleanList(tail_->prev, tail_);
   size_ = 0;
   head_ = nullptr;
   tail_ = nullptr;
-  x_->next = nullptr;
-  x_->prev = nullptr;
-  alloc_traits::deallocate(alloc_, x_, 1);
+  ReleaseSlabs();
 }
 
 /// -------------------------------Operators------------------------------------
@@ -428,16 +1618,18 @@ List<T, Allocator>& List<T, Allocator>::operator=(
   if (this == &other) {
     return *this;
   }
-  List<T, Allocator> tmp = other;
-  std::swap(size_, tmp.size_);
-  std::swap(head_, tmp.head_);
-  std::swap(tail_, tmp.tail_);
-  std::swap(x_, tmp.x_);
-
   if (alloc_traits::propagate_on_container_copy_assignment::value &&
       alloc_ != other.alloc_) {
-    alloc_ = other.alloc_;
+    // Our nodes can not be reused by the new allocator: copy into a list
+    // that already has it and take over its nodes together with it.
+    List<T, Allocator> tmp(other.GetAllocator());
+    tmp.Assign(other.Cbegin(), other.Cend());
+    SwapNodes(tmp);
+    SwapCaches(tmp);
+    std::swap(alloc_, tmp.alloc_);
+    return *this;
   }
+  Assign(other.Cbegin(), other.Cend());
   return *this;
 }
 
@@ -445,23 +1637,36 @@ template <typename T, typename Allocator>
 List<T, Allocator>& List<T, Allocator>::operator=(
     List<T, Allocator>&& other) noexcept {
   List<T, Allocator> tmp = std::move(other);
-  std::swap(size_, tmp.size_);
-  std::swap(head_, tmp.head_);
-  std::swap(tail_, tmp.tail_);
-  std::swap(x_, tmp.x_);
+  SwapNodes(tmp);
+  // Our old nodes are destroyed under our policy.
+  tmp.reclaimer_ = reclaimer_;
   if (alloc_traits::propagate_on_container_move_assignment::value &&
       alloc_ != tmp.alloc_) {
+    // Cached nodes go back to the allocator that made them.
+    SwapCaches(tmp);
     std::swap(alloc_, tmp.alloc_);
   }
   return *this;
 }
 
+template <typename T, typename Allocator>
+void List<T, Allocator>::Swap(List& other) noexcept {
+  if (this == &other) {
+    return;
+  }
+  SwapNodes(other);
+  SwapCaches(other);
+  if (alloc_traits::propagate_on_container_swap::value) {
+    std::swap(alloc_, other.alloc_);
+  }
+}
+
 /// -------------------------------Iterators------------------------------------
 
 template <typename T, typename Allocator>
 typename List<T, Allocator>::iterator List<T, Allocator>::Begin() const {
   if (head_ == nullptr) {
-    return List::iterator(x_);
+    return List::iterator(&x_);
   }
   return List::iterator(head_);
 }
@@ -469,19 +1674,43 @@ typename List<T, Allocator>::iterator List<T, Allocator>::Begin() const {
 template <typename T, typename Allocator>
 typename List<T, Allocator>::const_iterator List<T, Allocator>::Cbegin() const {
   if (head_ == nullptr) {
-    return List::const_iterator(x_);
+    return List::const_iterator(&x_);
   }
   return List::const_iterator(head_);
 }
 
 template <typename T, typename Allocator>
 typename List<T, Allocator>::iterator List<T, Allocator>::End() const {
-  return List::iterator(x_);
+  return List::iterator(&x_);
 }
 
 template <typename T, typename Allocator>
 typename List<T, Allocator>::const_iterator List<T, Allocator>::Cend() const {
-  return List::const_iterator(x_);
+  return List::const_iterator(&x_);
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::reverse_iterator List<T, Allocator>::Rbegin()
+    const {
+  return reverse_iterator(End());
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::const_reverse_iterator
+List<T, Allocator>::Crbegin() const {
+  return const_reverse_iterator(Cend());
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::reverse_iterator List<T, Allocator>::Rend()
+    const {
+  return reverse_iterator(Begin());
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::const_reverse_iterator List<T, Allocator>::Crend()
+    const {
+  return const_reverse_iterator(Cbegin());
 }
 
 /// -----------------------Element access methods-------------------------------
@@ -511,56 +1740,49 @@ const T& List<T, Allocator>::Back() const {
 template <typename T, typename Allocator>
 template <typename... Args>
 void List<T, Allocator>::EmplaceBack(Args&&... args) {
-  Node* next_node = nullptr;
-  try {
-    next_node = MakeNode(nullptr, std::forward<Args>(args)...);
-  } catch (...) {
-    alloc_traits::destroy(alloc_, next_node);
-    alloc_traits::deallocate(alloc_, next_node, 1);
-    alloc_traits::deallocate(alloc_, x_, 1);
-    throw;
+#if LIST_ENABLE_STATS && LIST_STATS_LATENCY
+  LatencyScope latency(stats_.emplace_back_latency);
+#endif
+  Node* next_node = MakeNode(nullptr, std::forward<Args>(args)...);
+  ++size_;
+  CountGrowth();
+  if (index_.built) {
+    IndexPushBack(next_node);
   }
-  if (Empty()) {
-    ++size_;
+  if (size_ == 1) {
     head_ = next_node;
     tail_ = next_node;
     SetEnds();
     return;
   }
-  ++size_;
-  Node* x_prev = x_->prev;
+  NodeBase* x_prev = x_.prev;
   x_prev->next = next_node;
   tail_ = next_node;
-  x_->prev = next_node;
+  x_.prev = next_node;
   next_node->prev = x_prev;
-  next_node->next = x_;
+  next_node->next = &x_;
 }
 
 template <typename T, typename Allocator>
 template <typename... Args>
 void List<T, Allocator>::EmplaceFront(Args&&... args) {
-  Node* next_node = nullptr;
-  try {
-    next_node = MakeNode(nullptr, std::forward<Args>(args)...);
-  } catch (...) {
-    alloc_traits::destroy(alloc_, next_node);
-    alloc_traits::deallocate(alloc_, next_node, 1);
-    alloc_traits::deallocate(alloc_, x_, 1);
-    throw;
+  Node* next_node = MakeNode(nullptr, std::forward<Args>(args)...);
+  ++size_;
+  CountGrowth();
+  if (index_.built) {
+    IndexPushFront(next_node);
   }
-  if (Empty()) {
-    ++size_;
+  if (size_ == 1) {
     head_ = next_node;
     tail_ = next_node;
     SetEnds();
     return;
   }
-  ++size_;
   Node* head_prev = head_;
-  x_->next = next_node;
+  x_.next = next_node;
   head_ = next_node;
   head_prev->prev = next_node;
-  next_node->prev = x_;
+  next_node->prev = &x_;
   next_node->next = head_prev;
 }
 
@@ -582,12 +1804,15 @@ void List<T, Allocator>::PopBack() {
     return;
   }
   Node* old_tail = tail_;
-  x_->prev = tail_->prev;
-  tail_->prev->next = x_;
-  tail_ = tail_->prev;
+  x_.prev = tail_->prev;
+  tail_->prev->next = &x_;
+  tail_ = AsNode(tail_->prev);
   alloc_traits::destroy(alloc_, old_tail);
-  alloc_traits::deallocate(alloc_, old_tail, 1);
+  ReleaseNode(old_tail);
   --size_;
+  if (index_.built) {
+    IndexPopBack(old_tail);
+  }
   if (Empty()) {
     head_ = nullptr;
     tail_ = nullptr;
@@ -596,18 +1821,4192 @@ void List<T, Allocator>::PopBack() {
 
 template <typename T, typename Allocator>
 void List<T, Allocator>::PopFront() {
+#if LIST_ENABLE_STATS && LIST_STATS_LATENCY
+  LatencyScope latency(stats_.pop_front_latency);
+#endif
   if (Empty()) {
     return;
   }
   Node* old_head = head_;
-  x_->next = head_->next;
-  head_->next->prev = x_;
-  head_ = head_->next;
+  x_.next = head_->next;
+  head_->next->prev = &x_;
+  head_ = AsNode(head_->next);
   alloc_traits::destroy(alloc_, old_head);
-  alloc_traits::deallocate(alloc_, old_head, 1);
+  ReleaseNode(old_head);
   --size_;
+  if (index_.built) {
+    IndexPopFront(old_head);
+  }
   if (Empty()) {
     head_ = nullptr;
     tail_ = nullptr;
   }
-}
\ No newline at end of file
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+typename List<T, Allocator>::iterator List<T, Allocator>::Emplace(
+    const_iterator pos, Args&&... args) {
+  Node* node = MakeNode(nullptr, std::forward<Args>(args)...);
+  LinkBefore(const_cast<NodeBase*>(pos.node_p_), node, node);
+  ++size_;
+  CountGrowth();
+  ResetEnds();
+  return iterator(node);
+}
+
+template <typename T, typename Allocator>
+template <typename U>
+typename List<T, Allocator>::iterator List<T, Allocator>::Insert(
+    const_iterator pos, U&& value) {
+  return Emplace(pos, std::forward<U>(value));
+}
+
+template <typename T, typename Allocator>
+template <typename InputIt>
+typename List<T, Allocator>::iterator List<T, Allocator>::InsertRange(
+    const_iterator pos, InputIt first, InputIt last) {
+  NodeBase* position = const_cast<NodeBase*>(pos.node_p_);
+  if (first == last) {
+    return iterator(position);
+  }
+  Node* chain_head = nullptr;
+  Node* chain_tail = nullptr;
+  size_t count = BuildChain(first, last, chain_head, chain_tail);
+  LinkBefore(position, chain_head, chain_tail);
+  size_ += count;
+  CountGrowth();
+  ResetEnds();
+  return iterator(chain_head);
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::iterator List<T, Allocator>::Erase(
+    const_iterator pos) {
+  NodeBase* node = const_cast<NodeBase*>(pos.node_p_);
+  NodeBase* next = node->next;
+  Unlink(node, node);
+  --size_;
+  ResetEnds();
+  alloc_traits::destroy(alloc_, AsNode(node));
+  ReleaseNode(AsNode(node));
+  return iterator(next);
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::iterator List<T, Allocator>::Erase(
+    const_iterator first, const_iterator last) {
+  NodeBase* next = const_cast<NodeBase*>(last.node_p_);
+  if (first == last) {
+    return iterator(next);
+  }
+  NodeBase* first_node = const_cast<NodeBase*>(first.node_p_);
+  NodeBase* last_node = next->prev;
+  Unlink(first_node, last_node);
+  size_ -= ReleaseChain(first_node, last_node);
+  ResetEnds();
+  return iterator(next);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::AppendToChain(Node*& head, Node*& tail, Node* node) {
+  if (tail == nullptr) {
+    head = node;
+  } else {
+    tail->next = node;
+    node->prev = tail;
+  }
+  tail = node;
+}
+
+template <typename T, typename Allocator>
+template <typename InputIt>
+size_t List<T, Allocator>::BuildChain(InputIt first, InputIt last,
+                                      Node*& head, Node*& tail) {
+  size_t count = 0;
+  try {
+    for (; first != last; ++first) {
+      AppendToChain(head, tail, MakeNode(nullptr, *first));
+      ++count;
+    }
+  } catch (...) {
+    if (head != nullptr) {
+      ReleaseChain(head, tail);
+    }
+    head = nullptr;
+    tail = nullptr;
+    throw;
+  }
+  return count;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::FinishAssign(NodeBase* node, Node* head, Node* tail,
+                                      size_t count) {
+  if (head != nullptr) {
+    LinkBefore(&x_, head, tail);
+    size_ += count;
+    CountGrowth();
+    ResetEnds();
+    return;
+  }
+  Erase(const_iterator(node), Cend());
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Assign(size_t count, const T& value) {
+  Node* chain_head = nullptr;
+  Node* chain_tail = nullptr;
+  size_t extra = 0;
+  try {
+    for (; size_ + extra < count; ++extra) {
+      AppendToChain(chain_head, chain_tail, MakeNode(nullptr, value));
+    }
+  } catch (...) {
+    if (chain_head != nullptr) {
+      ReleaseChain(chain_head, chain_tail);
+    }
+    throw;
+  }
+  NodeBase* node = x_.next;
+  try {
+    for (size_t i = 0; i < count && node != &x_; ++i, node = node->next) {
+      AsNode(node)->value = value;
+    }
+  } catch (...) {
+    if (chain_head != nullptr) {
+      ReleaseChain(chain_head, chain_tail);
+    }
+    throw;
+  }
+  FinishAssign(node, chain_head, chain_tail, extra);
+}
+
+template <typename T, typename Allocator>
+template <typename InputIt, typename>
+void List<T, Allocator>::Assign(InputIt first, InputIt last) {
+  AssignRange(first, last,
+              typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+// A single pass input range can not be looked ahead, so missing elements
+// are appended after the existing nodes were assigned.
+template <typename T, typename Allocator>
+template <typename InputIt>
+void List<T, Allocator>::AssignRange(InputIt first, InputIt last,
+                                     std::input_iterator_tag) {
+  NodeBase* node = x_.next;
+  for (; node != &x_ && first != last; node = node->next, ++first) {
+    AsNode(node)->value = *first;
+  }
+  if (first != last) {
+    InsertRange(Cend(), first, last);
+    return;
+  }
+  Erase(const_iterator(node), Cend());
+}
+
+template <typename T, typename Allocator>
+template <typename ForwardIt>
+void List<T, Allocator>::AssignRange(ForwardIt first, ForwardIt last,
+                                     std::forward_iterator_tag) {
+  ForwardIt rest = first;
+  for (size_t reused = 0; reused < size_ && rest != last; ++reused) {
+    ++rest;
+  }
+  Node* chain_head = nullptr;
+  Node* chain_tail = nullptr;
+  size_t extra = BuildChain(rest, last, chain_head, chain_tail);
+  NodeBase* node = x_.next;
+  try {
+    for (; first != rest; node = node->next, ++first) {
+      AsNode(node)->value = *first;
+    }
+  } catch (...) {
+    if (chain_head != nullptr) {
+      ReleaseChain(chain_head, chain_tail);
+    }
+    throw;
+  }
+  FinishAssign(node, chain_head, chain_tail, extra);
+}
+
+/// ---------------------------Splice, merge, sort-----------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Unlink(NodeBase* first, NodeBase* last) {
+  first->prev->next = last->next;
+  last->next->prev = first->prev;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::LinkBefore(NodeBase* position, NodeBase* first,
+                                    NodeBase* last) {
+  NodeBase* before = position->prev;
+  before->next = first;
+  first->prev = before;
+  last->next = position;
+  position->prev = last;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Splice(const_iterator pos, List& other) {
+  if (&other == this || other.Empty()) {
+    return;
+  }
+  AdoptSlabs(other);
+  other.EndCompactPass();
+  NodeBase* first = other.x_.next;
+  NodeBase* last = other.x_.prev;
+  Unlink(first, last);
+  LinkBefore(const_cast<NodeBase*>(pos.node_p_), first, last);
+  size_ += other.size_;
+  CountGrowth();
+  other.size_ = 0;
+  heap_nodes_ += other.heap_nodes_;
+  other.heap_nodes_ = 0;
+  ResetEnds();
+  other.ResetEnds();
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Splice(const_iterator pos, List& other,
+                                const_iterator it) {
+  NodeBase* position = const_cast<NodeBase*>(pos.node_p_);
+  NodeBase* node = const_cast<NodeBase*>(it.node_p_);
+  if (node == position || node->next == position) {
+    return;
+  }
+  if (&other != this) {
+    AdoptSlabs(other);
+    other.EndCompactPass();
+    ++size_;
+    ++heap_nodes_;
+    CountGrowth();
+    --other.size_;
+  }
+  Unlink(node, node);
+  LinkBefore(position, node, node);
+  ResetEnds();
+  other.ResetEnds();
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Splice(const_iterator pos, List& other,
+                                const_iterator first, const_iterator last) {
+  if (first == last) {
+    return;
+  }
+  NodeBase* first_node = const_cast<NodeBase*>(first.node_p_);
+  NodeBase* last_node = const_cast<NodeBase*>(last.node_p_)->prev;
+  if (&other != this) {
+    size_t count = 1;
+    for (NodeBase* node = first_node; node != last_node; node = node->next) {
+      ++count;
+    }
+    AdoptSlabs(other);
+    other.EndCompactPass();
+    size_ += count;
+    heap_nodes_ += count;
+    CountGrowth();
+    other.size_ -= count;
+  }
+  Unlink(first_node, last_node);
+  LinkBefore(const_cast<NodeBase*>(pos.node_p_), first_node, last_node);
+  ResetEnds();
+  other.ResetEnds();
+}
+
+template <typename T, typename Allocator>
+template <typename Compare>
+void List<T, Allocator>::Merge(List& other, Compare comp) {
+  if (&other == this || other.Empty()) {
+    return;
+  }
+  AdoptSlabs(other);
+  other.EndCompactPass();
+  NodeBase* current = x_.next;
+  NodeBase* incoming = other.x_.next;
+  try {
+    while (incoming != &other.x_) {
+      if (current == &x_) {
+        LinkBefore(&x_, incoming, other.x_.prev);
+        break;
+      }
+      if (comp(AsNode(incoming)->value, AsNode(current)->value)) {
+        NodeBase* next = incoming->next;
+        LinkBefore(current, incoming, incoming);
+        incoming = next;
+      } else {
+        current = current->next;
+      }
+    }
+  } catch (...) {
+    if (incoming != &other.x_) {
+      LinkBefore(&x_, incoming, other.x_.prev);
+    }
+    size_ += other.size_;
+    CountGrowth();
+    other.size_ = 0;
+    heap_nodes_ += other.heap_nodes_;
+    other.heap_nodes_ = 0;
+    ResetEnds();
+    other.ResetEnds();
+    throw;
+  }
+  size_ += other.size_;
+  CountGrowth();
+  other.size_ = 0;
+  heap_nodes_ += other.heap_nodes_;
+  other.heap_nodes_ = 0;
+  ResetEnds();
+  other.ResetEnds();
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::NodeBase* List<T, Allocator>::ConcatChains(
+    NodeBase* left, NodeBase* right) {
+  if (left == nullptr) {
+    return right;
+  }
+  NodeBase* last = left;
+  while (last->next != nullptr) {
+    last = last->next;
+  }
+  last->next = right;
+  return left;
+}
+
+// Merges two null-terminated chains linked through next only. On exception
+// all nodes are left in left and right is null.
+template <typename T, typename Allocator>
+template <typename Compare>
+typename List<T, Allocator>::NodeBase* List<T, Allocator>::MergeChains(
+    NodeBase*& left, NodeBase*& right, Compare& comp) {
+  NodeBase* head = nullptr;
+  NodeBase** link = &head;
+  try {
+    while (left != nullptr && right != nullptr) {
+      if (comp(AsNode(right)->value, AsNode(left)->value)) {
+        *link = right;
+        right = right->next;
+      } else {
+        *link = left;
+        left = left->next;
+      }
+      link = &(*link)->next;
+    }
+  } catch (...) {
+    *link = nullptr;
+    left = ConcatChains(ConcatChains(head, left), right);
+    right = nullptr;
+    throw;
+  }
+  *link = left != nullptr ? left : right;
+  left = nullptr;
+  right = nullptr;
+  return head;
+}
+
+// Bottom-up merge sort of a null-terminated chain. On exception head holds
+// all nodes in an unspecified order.
+template <typename T, typename Allocator>
+template <typename Compare>
+void List<T, Allocator>::SortChain(NodeBase*& head, Compare& comp) {
+  constexpr size_t kBins = 64;
+  NodeBase* bins[kBins] = {};
+  NodeBase* carry = nullptr;
+  try {
+    while (head != nullptr) {
+      carry = head;
+      head = head->next;
+      carry->next = nullptr;
+      size_t i = 0;
+      for (; bins[i] != nullptr; ++i) {
+        carry = MergeChains(bins[i], carry, comp);
+      }
+      bins[i] = carry;
+      carry = nullptr;
+    }
+    for (size_t i = 0; i < kBins; ++i) {
+      if (bins[i] != nullptr) {
+        NodeBase* merged = bins[i];
+        if (head != nullptr) {
+          merged = MergeChains(bins[i], head, comp);
+        }
+        head = merged;
+        bins[i] = nullptr;
+      }
+    }
+  } catch (...) {
+    for (NodeBase* bin : bins) {
+      head = ConcatChains(bin, head);
+    }
+    head = ConcatChains(carry, head);
+    throw;
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::LinkChain(NodeBase* head) {
+  NodeBase* prev = &x_;
+  x_.next = head;
+  for (NodeBase* node = head; node != nullptr; node = node->next) {
+    node->prev = prev;
+    prev = node;
+  }
+  prev->next = &x_;
+  x_.prev = prev;
+}
+
+template <typename T, typename Allocator>
+template <typename Compare>
+void List<T, Allocator>::Sort(Compare comp) {
+  if (size_ < 2) {
+    return;
+  }
+  NodeBase* head = x_.next;
+  x_.prev->next = nullptr;
+  try {
+    SortChain(head, comp);
+  } catch (...) {
+    LinkChain(head);
+    ResetEnds();
+    throw;
+  }
+  LinkChain(head);
+  ResetEnds();
+}
+
+// Runs task(0) .. task(tasks - 1), task(0) on the calling thread. A task that
+// could not get its own thread runs inline. Returns the first exception.
+template <typename T, typename Allocator>
+template <typename Task>
+std::exception_ptr List<T, Allocator>::RunParallel(size_t tasks, Task& task) {
+  std::vector<std::exception_ptr> errors(tasks);
+  auto run = [&task, &errors](size_t index) {
+    try {
+      task(index);
+    } catch (...) {
+      errors[index] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(tasks);
+  for (size_t index = 1; index < tasks; ++index) {
+    try {
+      workers.emplace_back(run, index);
+    } catch (const std::system_error&) {
+      run(index);
+    }
+  }
+  run(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (auto& error : errors) {
+    if (error) {
+      return error;
+    }
+  }
+  return nullptr;
+}
+
+template <typename T, typename Allocator>
+template <typename Compare>
+void List<T, Allocator>::ParallelSort(Compare comp, size_t threads,
+                                      size_t sequential_cutoff) {
+  if (threads == 0) {
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  if (threads > size_ / 2) {
+    threads = size_ / 2;
+  }
+  if (size_ < sequential_cutoff || threads < 2) {
+    Sort(comp);
+    return;
+  }
+
+  std::vector<NodeBase*> chains(threads);
+  NodeBase* node = x_.next;
+  for (size_t part = 0; part < threads; ++part) {
+    size_t length = size_ / threads + (part < size_ % threads ? 1 : 0);
+    chains[part] = node;
+    for (size_t i = 1; i < length; ++i) {
+      node = node->next;
+    }
+    NodeBase* next = node->next;
+    node->next = nullptr;
+    node = next;
+  }
+
+  // Level 0 sorts the parts, level k merges pairs 2^(k-1) parts apart. The
+  // same workers run every level: items are claimed from a shared counter,
+  // and a level starts once all items before it are done. A worker that
+  // could not be started runs inline and simply finds fewer items left.
+  std::vector<size_t> level_begin = {0, threads};
+  for (size_t step = 1; step < threads; step *= 2) {
+    level_begin.push_back(level_begin.back() +
+                          (threads - step + 2 * step - 1) / (2 * step));
+  }
+  std::vector<std::exception_ptr> errors(level_begin.back());
+  std::atomic<size_t> claimed = 0;
+  std::atomic<size_t> done = 0;
+  auto run_item = [&chains, &comp](size_t level, size_t item) {
+    Compare item_comp = comp;
+    if (level == 0) {
+      SortChain(chains[item], item_comp);
+      return;
+    }
+    size_t step = size_t(1) << (level - 1);
+    size_t left = item * 2 * step;
+    chains[left] = MergeChains(chains[left], chains[left + step], item_comp);
+  };
+  auto work = [&](size_t /*worker*/) {
+    for (size_t level = 0; level + 1 < level_begin.size(); ++level) {
+      for (size_t seen = done.load(std::memory_order_acquire);
+           seen < level_begin[level];
+           seen = done.load(std::memory_order_acquire)) {
+        done.wait(seen, std::memory_order_acquire);
+      }
+      for (size_t index = 0; index < level_begin[level]; ++index) {
+        if (errors[index]) {
+          return;
+        }
+      }
+      size_t item = claimed.load();
+      while (item < level_begin[level + 1]) {
+        if (!claimed.compare_exchange_weak(item, item + 1)) {
+          continue;
+        }
+        try {
+          run_item(level, item - level_begin[level]);
+        } catch (...) {
+          errors[item] = std::current_exception();
+        }
+        done.fetch_add(1, std::memory_order_release);
+        done.notify_all();
+        item = claimed.load();
+      }
+    }
+  };
+  std::exception_ptr error = RunParallel(threads, work);
+  for (size_t index = 0; index < errors.size() && !error; ++index) {
+    error = errors[index];
+  }
+
+  NodeBase* head = nullptr;
+  for (size_t part = threads; part > 0; --part) {
+    head = ConcatChains(chains[part - 1], head);
+  }
+  LinkChain(head);
+  ResetEnds();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/// ------------------------------Node cache------------------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::SetNodeCacheLimit(size_t limit) {
+  node_cache_limit_ = limit;
+  while (free_count_ > node_cache_limit_) {
+    Node* node = free_nodes_;
+    free_nodes_ = AsNode(node->next);
+    --free_count_;
+    alloc_traits::deallocate(alloc_, node, 1);
+    CountNodeDeallocations(1);
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReserveNodes(size_t count) {
+  if (node_cache_limit_ < count) {
+    node_cache_limit_ = count;
+  }
+  while (free_count_ < count) {
+    Node* node = alloc_traits::allocate(alloc_, 1);
+    CountNodeAllocations(1);
+    node->next = free_nodes_;
+    free_nodes_ = node;
+    ++free_count_;
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ShrinkToFit() {
+  while (free_nodes_ != nullptr) {
+    Node* node = free_nodes_;
+    free_nodes_ = AsNode(node->next);
+    alloc_traits::deallocate(alloc_, node, 1);
+    CountNodeDeallocations(1);
+  }
+  free_count_ = 0;
+}
+
+/// ---------------------------Deferred destruction-----------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ClearAsync() {
+  if (Empty()) {
+    return;
+  }
+  if (!DeferClear()) {
+    Erase(Cbegin(), Cend());
+  }
+}
+
+template <typename T, typename Allocator>
+bool List<T, Allocator>::DeferClear() noexcept {
+  size_t nodes = size_ + free_count_;
+#if LIST_ENABLE_STATS
+  ListStats stats = stats_;
+#endif
+  std::unique_ptr<Detached> detached;
+  ListReclaimer* reclaimer = reclaimer_;
+  try {
+    if (reclaimer == nullptr) {
+      reclaimer = &ListReclaimer::Default();
+    }
+    detached = std::make_unique<Detached>(std::move(*this));
+  } catch (...) {
+    return false;
+  }
+#if LIST_ENABLE_STATS
+  stats_ = stats;
+#endif
+  reclaimer->Submit(std::move(detached), nodes);
+  return true;
+}
+
+/// ------------------------------Compaction------------------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Relocate(NodeBase*& next, List::Node* slots,
+                                  size_t count, size_t& used) {
+  try {
+    while (used < count && next != &x_) {
+      Node* old_node = AsNode(next);
+      Node* new_node = slots + used;
+      alloc_traits::construct(alloc_, new_node,
+                              std::move_if_noexcept(old_node->value));
+      ++used;
+      new_node->prev = old_node->prev;
+      new_node->next = old_node->next;
+      new_node->prev->next = new_node;
+      new_node->next->prev = new_node;
+      next = new_node->next;
+      alloc_traits::destroy(alloc_, old_node);
+      ReleaseNode(old_node);
+    }
+  } catch (...) {
+    ResetEnds();
+    throw;
+  }
+  ResetEnds();
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::EndCompactPass() {
+  for (size_t i = compact_left_; i > 0; --i) {
+    compact_slots_[i - 1].next = slab_free_;
+    slab_free_ = compact_slots_ + i - 1;
+  }
+  compact_next_ = nullptr;
+  compact_slots_ = nullptr;
+  compact_left_ = 0;
+  compact_slab_ = nullptr;
+  compact_live_ = 0;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::FreeOldSlabs(const List::Node* keep) {
+  size_t kept = 0;
+  for (size_t i = 0; i < slab_count_; ++i) {
+    if (slabs_[i]->nodes == keep) {
+      slabs_[kept++] = slabs_[i];
+    } else {
+      ReleaseSlab(slabs_[i]);
+    }
+  }
+  slab_count_ = kept;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::Compact() {
+  EndCompactPass();
+  if (Empty()) {
+    ReleaseSlabs();
+    return;
+  }
+  Node* slots = AllocateSlab(size_);
+  NodeBase* next = x_.next;
+  size_t used = 0;
+  try {
+    Relocate(next, slots, size_, used);
+  } catch (...) {
+    compact_slots_ = slots + used;
+    compact_left_ = size_ - used;
+    EndCompactPass();
+    throw;
+  }
+  // Every element lives in the new slab now, so the spare slab nodes are
+  // all in the old slabs.
+  heap_nodes_ = 0;
+  slab_free_ = nullptr;
+  FreeOldSlabs(slots);
+}
+
+template <typename T, typename Allocator>
+bool List<T, Allocator>::CompactStep(size_t max_nodes) {
+  if (compact_next_ == nullptr) {
+    if (Empty()) {
+      return true;
+    }
+    compact_slots_ = AllocateSlab(size_);
+    compact_slab_ = compact_slots_;
+    compact_live_ = 0;
+    compact_left_ = size_;
+    compact_next_ = x_.next;
+  }
+  size_t used = 0;
+  try {
+    Relocate(compact_next_, compact_slots_, std::min(max_nodes, compact_left_),
+             used);
+  } catch (...) {
+    compact_slots_ += used;
+    compact_left_ -= used;
+    compact_live_ += used;
+    throw;
+  }
+  compact_slots_ += used;
+  compact_left_ -= used;
+  compact_live_ += used;
+  if (compact_next_ != &x_ && compact_left_ != 0) {
+    return false;
+  }
+  if (compact_live_ == size_) {
+    // Every element is in the pass slab. Spare nodes of the pass slab that
+    // were on slab_free_ are dropped with the rest of it; they come back
+    // when the slab is freed.
+    Node* slab = compact_slab_;
+    heap_nodes_ = 0;
+    slab_free_ = nullptr;
+    EndCompactPass();
+    FreeOldSlabs(slab);
+    return true;
+  }
+  EndCompactPass();
+  return true;
+}
+
+/// ----------------------------Bulk traversal----------------------------------
+
+template <typename T, typename Allocator>
+template <typename Visit>
+typename List<T, Allocator>::NodeBase* List<T, Allocator>::Walk(
+    Visit& visit, size_t prefetch_distance) const {
+  NodeBase* end = &x_;
+  NodeBase* ahead = prefetch_distance == 0 ? end : x_.next;
+  for (size_t i = 0; i < prefetch_distance && ahead != end; ++i) {
+    ahead = ahead->next;
+    Prefetch(ahead);
+  }
+  NodeBase* node = x_.next;
+  while (node != end && visit(AsNode(node))) {
+    if (ahead != end) {
+      ahead = ahead->next;
+      Prefetch(ahead);
+    }
+    node = node->next;
+  }
+  return node;
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ForEach(F f, size_t prefetch_distance) {
+  auto visit = [&f](Node* node) {
+    f(node->value);
+    return true;
+  };
+  Walk(visit, prefetch_distance);
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ForEach(F f, size_t prefetch_distance) const {
+  auto visit = [&f](const Node* node) {
+    f(node->value);
+    return true;
+  };
+  Walk(visit, prefetch_distance);
+}
+
+template <typename T, typename Allocator>
+template <typename U, typename BinaryOp>
+U List<T, Allocator>::Accumulate(U init, BinaryOp op,
+                                 size_t prefetch_distance) const {
+  auto visit = [&init, &op](const Node* node) {
+    init = op(std::move(init), node->value);
+    return true;
+  };
+  Walk(visit, prefetch_distance);
+  return init;
+}
+
+template <typename T, typename Allocator>
+template <typename Pred>
+typename List<T, Allocator>::iterator List<T, Allocator>::FindIf(
+    Pred pred, size_t prefetch_distance) const {
+  auto visit = [&pred](const Node* node) { return !pred(node->value); };
+  return iterator(Walk(visit, prefetch_distance));
+}
+
+// The count does not depend on the order of visits, so two cursors walk
+// from both ends towards the middle: two independent chains of loads keep
+// two cache misses in flight instead of one.
+template <typename T, typename Allocator>
+template <typename Pred>
+size_t List<T, Allocator>::CountIf(Pred pred) const {
+  size_t count = 0;
+  NodeBase* front = x_.next;
+  NodeBase* back = x_.prev;
+  for (size_t steps = size_ / 2; steps > 0; --steps) {
+    count += pred(AsNode(front)->value) ? 1 : 0;
+    count += pred(AsNode(back)->value) ? 1 : 0;
+    front = front->next;
+    back = back->prev;
+  }
+  if (size_ % 2 != 0) {
+    count += pred(AsNode(front)->value) ? 1 : 0;
+  }
+  return count;
+}
+
+/// -----------------------------Serialization----------------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::WriteBytes(std::ostream& out, const void* data,
+                                    size_t bytes) {
+  out.write(static_cast<const char*>(data),
+            static_cast<std::streamsize>(bytes));
+  if (!out) {
+    throw std::runtime_error("List: write failed");
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReadBytes(std::istream& in, void* data,
+                                   size_t bytes) {
+  in.read(static_cast<char*>(data), static_cast<std::streamsize>(bytes));
+  if (static_cast<size_t>(in.gcount()) != bytes) {
+    throw std::runtime_error("List: truncated snapshot");
+  }
+}
+
+#if LIST_POSIX_IO
+template <typename T, typename Allocator>
+void List<T, Allocator>::WriteBytes(int fd, const void* data, size_t bytes) {
+  const char* begin = static_cast<const char*>(data);
+  while (bytes > 0) {
+    ssize_t written = ::write(fd, begin, bytes);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "List: write");
+    }
+    begin += written;
+    bytes -= static_cast<size_t>(written);
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::ReadBytes(int fd, void* data, size_t bytes) {
+  char* begin = static_cast<char*>(data);
+  while (bytes > 0) {
+    ssize_t got = ::read(fd, begin, bytes);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "List: read");
+    }
+    if (got == 0) {
+      throw std::runtime_error("List: truncated snapshot");
+    }
+    begin += got;
+    bytes -= static_cast<size_t>(got);
+  }
+}
+#endif
+
+template <typename T, typename Allocator>
+template <typename Sink>
+void List<T, Allocator>::WriteSnapshot(Sink& sink) const {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "only lists of trivially copyable types can be serialized");
+  SerialHeader header{kSerialMagic, static_cast<uint32_t>(sizeof(T)),
+                      static_cast<uint64_t>(size_)};
+  WriteBytes(sink, &header, sizeof(header));
+  std::vector<unsigned char> block(kSerialBlockElements * sizeof(T));
+  size_t used = 0;
+  for (NodeBase* node = x_.next; node != &x_; node = node->next) {
+    std::memcpy(block.data() + used, &AsNode(node)->value, sizeof(T));
+    used += sizeof(T);
+    if (used == block.size()) {
+      WriteBytes(sink, block.data(), used);
+      used = 0;
+    }
+  }
+  if (used != 0) {
+    WriteBytes(sink, block.data(), used);
+  }
+}
+
+template <typename T, typename Allocator>
+template <typename Source>
+size_t List<T, Allocator>::ReadHeader(Source& source) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "only lists of trivially copyable types can be serialized");
+  SerialHeader header;
+  ReadBytes(source, &header, sizeof(header));
+  if (header.magic != kSerialMagic || header.element_size != sizeof(T)) {
+    throw std::runtime_error("List: not a snapshot of this element type");
+  }
+  return static_cast<size_t>(header.count);
+}
+
+template <typename T, typename Allocator>
+template <typename Source>
+void List<T, Allocator>::ReadNodes(Source& source, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  Node* nodes = AllocateSlab(count);
+  size_t constructed = 0;
+  try {
+    std::vector<std::aligned_storage_t<sizeof(T), alignof(T)>> block(
+        std::min(count, kSerialBlockElements));
+    while (constructed < count) {
+      size_t batch = std::min(count - constructed, block.size());
+      ReadBytes(source, block.data(), batch * sizeof(T));
+      for (size_t i = 0; i < batch; ++i) {
+        alloc_traits::construct(
+            alloc_, nodes + constructed,
+            *std::launder(reinterpret_cast<const T*>(&block[i])));
+        ++constructed;
+      }
+    }
+  } catch (...) {
+    DropSlab(nodes, constructed);
+    throw;
+  }
+  size_ = count;
+  LinkSlab(nodes, count);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::SerializeTo(std::ostream& out) const {
+  WriteSnapshot(out);
+}
+
+template <typename T, typename Allocator>
+List<T, Allocator> List<T, Allocator>::Deserialize(std::istream& in,
+                                                   const Allocator& alloc) {
+  List list(alloc);
+  list.ReadNodes(in, ReadHeader(in));
+  return list;
+}
+
+#if LIST_POSIX_IO
+template <typename T, typename Allocator>
+void List<T, Allocator>::SerializeTo(int fd) const {
+  WriteSnapshot(fd);
+}
+
+template <typename T, typename Allocator>
+List<T, Allocator> List<T, Allocator>::Deserialize(int fd,
+                                                   const Allocator& alloc) {
+  List list(alloc);
+  list.ReadNodes(fd, ReadHeader(fd));
+  return list;
+}
+#endif
+
+/// --------------------------Parallel algorithms-------------------------------
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::Segments List<T, Allocator>::Split(
+    size_t parts) const {
+  if (parts == 0) {
+    parts = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    parts = std::min(parts, size_ / kParallelMinSegment);
+  }
+  parts = std::max<size_t>(std::min(parts, size_), 1);
+  Segments segments;
+  segments.bounds_.resize(parts + 1);
+  segments.bounds_[parts] = &x_;
+  std::vector<size_t> starts(parts);
+  for (size_t part = 1; part < parts; ++part) {
+    starts[part] = starts[part - 1] + size_ / parts +
+                   (part - 1 < size_ % parts ? 1 : 0);
+  }
+  // Bounds in the first half are found from the head, the rest from the
+  // tail.
+  size_t half = size_ / 2;
+  auto walk = [this, &segments, &starts, parts, half](size_t side) {
+    if (side == 0) {
+      NodeBase* node = x_.next;
+      size_t index = 0;
+      for (size_t part = 0; part < parts && starts[part] <= half; ++part) {
+        for (; index < starts[part]; ++index) {
+          node = node->next;
+        }
+        segments.bounds_[part] = node;
+      }
+      return;
+    }
+    NodeBase* node = x_.prev;
+    size_t index = size_ - 1;
+    for (size_t part = parts; part > 0 && starts[part - 1] > half; --part) {
+      for (; index > starts[part - 1]; --index) {
+        node = node->prev;
+      }
+      segments.bounds_[part - 1] = node;
+    }
+  };
+  if (parts > 2 && size_ >= kParallelSortCutoff) {
+    RunParallel(2, walk);
+  } else {
+    walk(0);
+    walk(1);
+  }
+  return segments;
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ParallelForEach(F f, size_t threads) {
+  ParallelForEach(f, Split(threads));
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ParallelForEach(F f, const Segments& segments) {
+  auto run = [&f, &segments](size_t part) {
+    F part_f = f;
+    NodeBase* end = segments.bounds_[part + 1];
+    for (NodeBase* node = segments.bounds_[part]; node != end;
+         node = node->next) {
+      part_f(AsNode(node)->value);
+    }
+  };
+  std::exception_ptr error = RunParallel(segments.Count(), run);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ParallelForEach(F f, size_t threads) const {
+  ParallelForEach(f, Split(threads));
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void List<T, Allocator>::ParallelForEach(F f, const Segments& segments) const {
+  auto run = [&f, &segments](size_t part) {
+    F part_f = f;
+    NodeBase* end = segments.bounds_[part + 1];
+    for (NodeBase* node = segments.bounds_[part]; node != end;
+         node = node->next) {
+      part_f(static_cast<const T&>(AsNode(node)->value));
+    }
+  };
+  std::exception_ptr error = RunParallel(segments.Count(), run);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+template <typename T, typename Allocator>
+template <typename U, typename BinaryOp>
+U List<T, Allocator>::ParallelReduce(U init, BinaryOp op,
+                                     size_t threads) const {
+  return ParallelReduce(std::move(init), op, Split(threads));
+}
+
+template <typename T, typename Allocator>
+template <typename U, typename BinaryOp>
+U List<T, Allocator>::ParallelReduce(U init, BinaryOp op,
+                                     const Segments& segments) const {
+  return ParallelTransformReduce(std::move(init), op,
+                                 [](const T& value) -> const T& {
+                                   return value;
+                                 },
+                                 segments);
+}
+
+template <typename T, typename Allocator>
+template <typename U, typename ReduceOp, typename TransformOp>
+U List<T, Allocator>::ParallelTransformReduce(U init, ReduceOp reduce,
+                                              TransformOp transform,
+                                              size_t threads) const {
+  return ParallelTransformReduce(std::move(init), reduce, transform,
+                                 Split(threads));
+}
+
+template <typename T, typename Allocator>
+template <typename U, typename ReduceOp, typename TransformOp>
+U List<T, Allocator>::ParallelTransformReduce(U init, ReduceOp reduce,
+                                              TransformOp transform,
+                                              const Segments& segments) const {
+  std::vector<std::optional<U>> partial(segments.Count());
+  auto run = [&](size_t part) {
+    ReduceOp part_reduce = reduce;
+    TransformOp part_transform = transform;
+    NodeBase* node = segments.bounds_[part];
+    NodeBase* end = segments.bounds_[part + 1];
+    if (node == end) {
+      return;
+    }
+    U result = part_transform(static_cast<const T&>(AsNode(node)->value));
+    for (node = node->next; node != end; node = node->next) {
+      result = part_reduce(std::move(result),
+                           part_transform(static_cast<const T&>(
+                               AsNode(node)->value)));
+    }
+    partial[part].emplace(std::move(result));
+  };
+  std::exception_ptr error = RunParallel(segments.Count(), run);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  for (auto& result : partial) {
+    if (result) {
+      init = reduce(std::move(init), std::move(*result));
+    }
+  }
+  return init;
+}
+
+/// ----------------------------Positional index--------------------------------
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::SetPositionIndexStride(size_t stride) {
+  DropIndex();
+  index_.stride = stride;
+  index_.nodes.shrink_to_fit();
+  typename PositionIndex::seq_map(index_.seq.get_allocator())
+      .swap(index_.seq);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::BuildIndex() {
+  index_.nodes.clear();
+  index_.seq.clear();
+  index_.nodes.reserve(size_ / index_.stride + 1);
+  index_.seq.reserve(size_ / index_.stride + 1);
+  size_t position = 0;
+  for (NodeBase* node = x_.next; node != &x_; node = node->next) {
+    if (position % index_.stride == 0) {
+      index_.seq.emplace(node, static_cast<int64_t>(index_.nodes.size()));
+      index_.nodes.push_back(node);
+    }
+    ++position;
+  }
+  index_.first = 0;
+  index_.first_seq = 0;
+  index_.shift = 0;
+  index_.built = true;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::DropIndex() {
+  if (!index_.built) {
+    return;
+  }
+  index_.nodes.clear();
+  index_.seq.clear();
+  index_.first = 0;
+  index_.first_seq = 0;
+  index_.shift = 0;
+  index_.built = false;
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::IndexPushBack(NodeBase* node) {
+  size_t position = size_ - 1;
+  if (position < index_.shift ||
+      (position - index_.shift) % index_.stride != 0) {
+    return;
+  }
+  index_.seq.emplace(node, index_.first_seq +
+                               static_cast<int64_t>(index_.Count()));
+  index_.nodes.push_back(node);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::IndexPushFront(NodeBase* node) {
+  // Every position moves by one; the new head becomes an entry once the
+  // entries are a whole stride away from it.
+  if (++index_.shift < index_.stride) {
+    return;
+  }
+  index_.shift = 0;
+  if (index_.first == 0) {
+    size_t room = std::max<size_t>(index_.Count(), 8);
+    index_.nodes.insert(index_.nodes.begin(), room, nullptr);
+    index_.first = room;
+  }
+  index_.nodes[--index_.first] = node;
+  index_.seq.emplace(node, --index_.first_seq);
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::IndexPopBack(NodeBase* node) {
+  if (index_.Count() != 0 && index_.nodes.back() == node) {
+    index_.seq.erase(node);
+    index_.nodes.pop_back();
+  }
+}
+
+template <typename T, typename Allocator>
+void List<T, Allocator>::IndexPopFront(NodeBase* node) {
+  if (index_.Count() == 0 || index_.nodes[index_.first] != node) {
+    if (index_.shift > 0) {
+      --index_.shift;
+    }
+    return;
+  }
+  index_.seq.erase(node);
+  ++index_.first;
+  ++index_.first_seq;
+  index_.shift = index_.stride - 1;
+  if (index_.first > 2 * index_.Count() + 64) {
+    index_.nodes.erase(index_.nodes.begin(),
+                       index_.nodes.begin() + index_.first);
+    index_.first = 0;
+  }
+}
+
+template <typename T, typename Allocator>
+size_t List<T, Allocator>::PositionOf(const NodeBase* node) const {
+  size_t steps = 0;
+  while (node != &x_) {
+    auto entry = index_.seq.find(node);
+    if (entry != index_.seq.end()) {
+      size_t j = static_cast<size_t>(entry->second - index_.first_seq);
+      return j * index_.stride + index_.shift - steps;
+    }
+    node = node->next;
+    ++steps;
+  }
+  return size_ - steps;
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::NodeBase* List<T, Allocator>::NodeAt(
+    size_t position) const {
+  NodeBase* node = x_.next;
+  size_t at = 0;
+  if (index_.built && index_.Count() != 0 && position >= index_.shift) {
+    size_t j = std::min((position - index_.shift) / index_.stride,
+                        index_.Count() - 1);
+    node = index_.nodes[index_.first + j];
+    at = j * index_.stride + index_.shift;
+  }
+  if (size_ - position < position - at) {
+    node = &x_;
+    for (size_t i = size_; i > position; --i) {
+      node = node->prev;
+    }
+    return node;
+  }
+  for (; at < position; ++at) {
+    node = node->next;
+  }
+  return node;
+}
+
+template <typename T, typename Allocator>
+T& List<T, Allocator>::At(size_t i) {
+  if (index_.stride != 0 && !index_.built) {
+    BuildIndex();
+  }
+  return AsNode(NodeAt(i))->value;
+}
+
+template <typename T, typename Allocator>
+const T& List<T, Allocator>::At(size_t i) const {
+  return AsNode(NodeAt(i))->value;
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::iterator List<T, Allocator>::Advance(
+    const_iterator it, std::ptrdiff_t k) {
+  if (index_.stride != 0 && !index_.built) {
+    BuildIndex();
+  }
+  return std::as_const(*this).Advance(it, k);
+}
+
+template <typename T, typename Allocator>
+typename List<T, Allocator>::iterator List<T, Allocator>::Advance(
+    const_iterator it, std::ptrdiff_t k) const {
+  NodeBase* node = const_cast<NodeBase*>(it.node_p_);
+  if (!index_.built) {
+    for (; k > 0; --k) {
+      node = node->next;
+    }
+    for (; k < 0; ++k) {
+      node = node->prev;
+    }
+    return iterator(node);
+  }
+  size_t position = PositionOf(node) + k;
+  return iterator(position == size_ ? &x_ : NodeAt(position));
+}
+
+template <typename T, typename Allocator>
+std::ptrdiff_t List<T, Allocator>::Distance(const_iterator first,
+                                            const_iterator last) {
+  if (index_.stride != 0 && !index_.built) {
+    BuildIndex();
+  }
+  return std::as_const(*this).Distance(first, last);
+}
+
+template <typename T, typename Allocator>
+std::ptrdiff_t List<T, Allocator>::Distance(const_iterator first,
+                                            const_iterator last) const {
+  if (!index_.built) {
+    std::ptrdiff_t distance = 0;
+    for (; first != last; ++first) {
+      ++distance;
+    }
+    return distance;
+  }
+  return static_cast<std::ptrdiff_t>(PositionOf(last.node_p_)) -
+         static_cast<std::ptrdiff_t>(PositionOf(first.node_p_));
+}
+
+/// ------------------------------Statistics------------------------------------
+
+template <typename T, typename Allocator>
+ListStats List<T, Allocator>::Stats() const {
+#if LIST_ENABLE_STATS
+  ListStats stats = stats_;
+  stats.enabled = true;
+  stats.size = size_;
+  stats.cached_nodes = free_count_;
+  size_t nodes = size_ + free_count_;
+  for (NodeBase* node = slab_free_; node != nullptr; node = node->next) {
+    ++nodes;
+  }
+  stats.bytes_held = nodes * sizeof(Node);
+  return stats;
+#else
+  return ListStats();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// UnrolledList: the same interface as List, but every node (chunk) stores up
+/// to K elements, so small T pay for next/prev once per chunk and traversal
+/// walks contiguous memory. By default K is chosen so that a chunk occupies
+/// about kUnrolledChunkBytes.
+
+inline constexpr size_t kUnrolledChunkBytes = 256;
+
+template <typename T>
+constexpr size_t UnrolledChunkCapacity() {
+  constexpr size_t kHeader = 2 * sizeof(void*) + 2 * sizeof(uint32_t);
+  return kHeader + sizeof(T) < kUnrolledChunkBytes
+             ? (kUnrolledChunkBytes - kHeader) / sizeof(T)
+             : 1;
+}
+
+template <typename T, typename Allocator = std::allocator<T>,
+          size_t K = UnrolledChunkCapacity<T>()>
+class UnrolledList {
+  static_assert(K > 0, "chunk capacity must be positive");
+
+  template <bool is_const>
+  class ChunkIterator;
+
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using iterator = ChunkIterator<false>;
+  using const_iterator = ChunkIterator<true>;
+
+  static constexpr size_t kChunkCapacity = K;
+
+  UnrolledList();
+
+  explicit UnrolledList(size_t count, const T& value,
+                        const Allocator& alloc = Allocator());
+
+  explicit UnrolledList(size_t count, const Allocator& alloc = Allocator());
+
+  UnrolledList(const UnrolledList& other);
+
+  UnrolledList(const UnrolledList& other, const Allocator& alloc);
+
+  UnrolledList(UnrolledList&& other) noexcept;
+
+  UnrolledList(std::initializer_list<value_type> init,
+               const Allocator& alloc = Allocator());
+
+  ~UnrolledList();
+
+  UnrolledList& operator=(const UnrolledList& other);
+  UnrolledList& operator=(UnrolledList&& other) noexcept(
+      std::allocator_traits<
+          Allocator>::propagate_on_container_move_assignment::value ||
+      std::allocator_traits<Allocator>::is_always_equal::value);
+
+  [[nodiscard]] size_t Size() const { return size_; }
+
+  [[nodiscard]] bool Empty() const { return size_ == 0; }
+  [[nodiscard]] allocator_type GetAllocator() const noexcept { return alloc_; }
+
+  [[nodiscard]] iterator Begin() const;
+  [[nodiscard]] const_iterator Cbegin() const;
+  [[nodiscard]] iterator End() const;
+  [[nodiscard]] const_iterator Cend() const;
+
+  value_type& Front();
+  [[nodiscard]] const value_type& Front() const;
+  value_type& Back();
+  [[nodiscard]] const value_type& Back() const;
+
+  template <typename... Args>
+  void EmplaceBack(Args&&... args);
+
+  template <typename... Args>
+  void EmplaceFront(Args&&... args);
+
+  template <typename U>
+  void PushBack(U&& value);
+
+  template <typename U>
+  void PushFront(U&& value);
+
+  void PopBack();
+  void PopFront();
+
+  void Clear();
+
+  void Swap(UnrolledList& other) noexcept;
+
+  private:
+  struct ChunkBase {
+    ChunkBase* next;
+    ChunkBase* prev;
+    uint32_t begin;
+    uint32_t end;
+  };
+  struct Chunk;
+
+  // Sentinel lives inside the object: begin == end == 0 makes End() a regular
+  // (chunk, index) position for the iterator.
+  mutable ChunkBase x_{&x_, &x_, 0, 0};
+  size_t size_ = 0;
+
+  using alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Chunk>;
+  using alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Chunk>;
+  alloc_type alloc_;
+
+  static Chunk* AsChunk(ChunkBase* base) { return static_cast<Chunk*>(base); }
+
+  Chunk* MakeChunk(uint32_t position);
+
+  void LinkBefore(ChunkBase* position, ChunkBase* chunk);
+
+  void FreeChunk(ChunkBase* chunk);
+
+  void RelinkSentinel();
+
+  void StealChain(UnrolledList& other);
+};
+
+template <typename T, typename Allocator, size_t K>
+struct UnrolledList<T, Allocator, K>::Chunk : ChunkBase {
+  T* Data() { return std::launder(reinterpret_cast<T*>(storage)); }
+
+  alignas(T) unsigned char storage[K * sizeof(T)];
+};
+
+template <typename T, typename Allocator, size_t K>
+template <bool is_const>
+class UnrolledList<T, Allocator, K>::ChunkIterator {
+  friend class UnrolledList<T, Allocator, K>;
+
+  public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const T*, T*>;
+  using reference = std::conditional_t<is_const, const T&, T&>;
+
+  ChunkIterator(ChunkBase* chunk, uint32_t index)
+      : chunk_(chunk), index_(index) {}
+
+  reference operator*() const { return AsChunk(chunk_)->Data()[index_]; }
+
+  pointer operator->() const { return AsChunk(chunk_)->Data() + index_; }
+
+  ChunkIterator& operator++() {
+    if (++index_ == chunk_->end) {
+      chunk_ = chunk_->next;
+      index_ = chunk_->begin;
+    }
+    return *this;
+  }
+
+  ChunkIterator& operator--() {
+    if (index_ == chunk_->begin) {
+      chunk_ = chunk_->prev;
+      index_ = chunk_->end;
+    }
+    --index_;
+    return *this;
+  }
+
+  bool operator==(const ChunkIterator& other) const {
+    return chunk_ == other.chunk_ && index_ == other.index_;
+  }
+
+  bool operator!=(const ChunkIterator& other) const {
+    return !(*this == other);
+  }
+
+  private:
+  ChunkBase* chunk_;
+  uint32_t index_;
+};
+
+template <typename T, typename Allocator, size_t K>
+typename UnrolledList<T, Allocator, K>::Chunk*
+UnrolledList<T, Allocator, K>::MakeChunk(uint32_t position) {
+  Chunk* chunk = alloc_traits::allocate(alloc_, 1);
+  chunk->begin = position;
+  chunk->end = position;
+  return chunk;
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::LinkBefore(ChunkBase* position,
+                                               ChunkBase* chunk) {
+  chunk->next = position;
+  chunk->prev = position->prev;
+  position->prev->next = chunk;
+  position->prev = chunk;
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::FreeChunk(ChunkBase* chunk) {
+  chunk->prev->next = chunk->next;
+  chunk->next->prev = chunk->prev;
+  alloc_traits::deallocate(alloc_, AsChunk(chunk), 1);
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::RelinkSentinel() {
+  if (Empty()) {
+    x_.next = &x_;
+    x_.prev = &x_;
+    return;
+  }
+  x_.next->prev = &x_;
+  x_.prev->next = &x_;
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::StealChain(UnrolledList& other) {
+  x_.next = other.x_.next;
+  x_.prev = other.x_.prev;
+  size_ = other.size_;
+  RelinkSentinel();
+  other.size_ = 0;
+  other.RelinkSentinel();
+}
+
+/// -------------------------------Constructors---------------------------------
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList() = default;
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(size_t count, const T& value,
+                                            const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      EmplaceBack(value);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(size_t count,
+                                            const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      EmplaceBack();
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(const UnrolledList& other)
+    : UnrolledList(other, std::allocator_traits<Allocator>::
+                              select_on_container_copy_construction(
+                                  other.GetAllocator())) {}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(const UnrolledList& other,
+                                            const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (auto it = other.Cbegin(); it != other.Cend(); ++it) {
+      EmplaceBack(*it);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(UnrolledList&& other) noexcept
+    : alloc_(std::move(other.alloc_)) {
+  StealChain(other);
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::UnrolledList(
+    std::initializer_list<value_type> init, const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (auto iter = init.begin(); iter != init.end(); ++iter) {
+      EmplaceBack(*iter);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>::~UnrolledList() {
+  Clear();
+}
+
+/// -------------------------------Operators------------------------------------
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>& UnrolledList<T, Allocator, K>::operator=(
+    const UnrolledList& other) {
+  if (this == &other) {
+    return *this;
+  }
+  Allocator alloc = std::allocator_traits<
+                        Allocator>::propagate_on_container_copy_assignment::value
+                        ? other.GetAllocator()
+                        : GetAllocator();
+  UnrolledList tmp(other, alloc);
+  Clear();
+  alloc_ = tmp.alloc_;
+  StealChain(tmp);
+  return *this;
+}
+
+template <typename T, typename Allocator, size_t K>
+UnrolledList<T, Allocator, K>& UnrolledList<T, Allocator, K>::operator=(
+    UnrolledList&& other) noexcept(std::allocator_traits<Allocator>::
+                                       propagate_on_container_move_assignment::
+                                           value ||
+                                   std::allocator_traits<
+                                       Allocator>::is_always_equal::value) {
+  if (this == &other) {
+    return *this;
+  }
+  Clear();
+  if (alloc_traits::propagate_on_container_move_assignment::value) {
+    alloc_ = std::move(other.alloc_);
+    StealChain(other);
+  } else if (alloc_ == other.alloc_) {
+    StealChain(other);
+  } else {
+    for (auto it = other.Begin(); it != other.End(); ++it) {
+      EmplaceBack(std::move(*it));
+    }
+    other.Clear();
+  }
+  return *this;
+}
+
+/// -------------------------------Iterators------------------------------------
+
+template <typename T, typename Allocator, size_t K>
+typename UnrolledList<T, Allocator, K>::iterator
+UnrolledList<T, Allocator, K>::Begin() const {
+  return iterator(x_.next, x_.next->begin);
+}
+
+template <typename T, typename Allocator, size_t K>
+typename UnrolledList<T, Allocator, K>::const_iterator
+UnrolledList<T, Allocator, K>::Cbegin() const {
+  return const_iterator(x_.next, x_.next->begin);
+}
+
+template <typename T, typename Allocator, size_t K>
+typename UnrolledList<T, Allocator, K>::iterator
+UnrolledList<T, Allocator, K>::End() const {
+  return iterator(&x_, 0);
+}
+
+template <typename T, typename Allocator, size_t K>
+typename UnrolledList<T, Allocator, K>::const_iterator
+UnrolledList<T, Allocator, K>::Cend() const {
+  return const_iterator(&x_, 0);
+}
+
+/// -----------------------Element access methods-------------------------------
+
+template <typename T, typename Allocator, size_t K>
+T& UnrolledList<T, Allocator, K>::Front() {
+  return AsChunk(x_.next)->Data()[x_.next->begin];
+}
+
+template <typename T, typename Allocator, size_t K>
+const T& UnrolledList<T, Allocator, K>::Front() const {
+  return AsChunk(x_.next)->Data()[x_.next->begin];
+}
+
+template <typename T, typename Allocator, size_t K>
+T& UnrolledList<T, Allocator, K>::Back() {
+  return AsChunk(x_.prev)->Data()[x_.prev->end - 1];
+}
+
+template <typename T, typename Allocator, size_t K>
+const T& UnrolledList<T, Allocator, K>::Back() const {
+  return AsChunk(x_.prev)->Data()[x_.prev->end - 1];
+}
+
+/// ------------------------------Modifiers-------------------------------------
+
+template <typename T, typename Allocator, size_t K>
+template <typename... Args>
+void UnrolledList<T, Allocator, K>::EmplaceBack(Args&&... args) {
+  ChunkBase* tail = x_.prev;
+  if (tail != &x_ && tail->end < K) {
+    alloc_traits::construct(alloc_, AsChunk(tail)->Data() + tail->end,
+                            std::forward<Args>(args)...);
+    ++tail->end;
+    ++size_;
+    return;
+  }
+  Chunk* chunk = MakeChunk(0);
+  try {
+    alloc_traits::construct(alloc_, chunk->Data(), std::forward<Args>(args)...);
+  } catch (...) {
+    alloc_traits::deallocate(alloc_, chunk, 1);
+    throw;
+  }
+  chunk->end = 1;
+  LinkBefore(&x_, chunk);
+  ++size_;
+}
+
+template <typename T, typename Allocator, size_t K>
+template <typename... Args>
+void UnrolledList<T, Allocator, K>::EmplaceFront(Args&&... args) {
+  ChunkBase* head = x_.next;
+  if (head != &x_ && head->begin > 0) {
+    alloc_traits::construct(alloc_, AsChunk(head)->Data() + head->begin - 1,
+                            std::forward<Args>(args)...);
+    --head->begin;
+    ++size_;
+    return;
+  }
+  Chunk* chunk = MakeChunk(K);
+  try {
+    alloc_traits::construct(alloc_, chunk->Data() + K - 1,
+                            std::forward<Args>(args)...);
+  } catch (...) {
+    alloc_traits::deallocate(alloc_, chunk, 1);
+    throw;
+  }
+  chunk->begin = K - 1;
+  LinkBefore(x_.next, chunk);
+  ++size_;
+}
+
+template <typename T, typename Allocator, size_t K>
+template <typename U>
+void UnrolledList<T, Allocator, K>::PushBack(U&& value) {
+  EmplaceBack(std::forward<U>(value));
+}
+
+template <typename T, typename Allocator, size_t K>
+template <typename U>
+void UnrolledList<T, Allocator, K>::PushFront(U&& value) {
+  EmplaceFront(std::forward<U>(value));
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::PopBack() {
+  if (Empty()) {
+    return;
+  }
+  ChunkBase* tail = x_.prev;
+  --tail->end;
+  alloc_traits::destroy(alloc_, AsChunk(tail)->Data() + tail->end);
+  --size_;
+  if (tail->begin == tail->end) {
+    FreeChunk(tail);
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::PopFront() {
+  if (Empty()) {
+    return;
+  }
+  ChunkBase* head = x_.next;
+  alloc_traits::destroy(alloc_, AsChunk(head)->Data() + head->begin);
+  ++head->begin;
+  --size_;
+  if (head->begin == head->end) {
+    FreeChunk(head);
+  }
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::Clear() {
+  ChunkBase* chunk = x_.next;
+  while (chunk != &x_) {
+    ChunkBase* next = chunk->next;
+    for (uint32_t i = chunk->begin; i < chunk->end; ++i) {
+      alloc_traits::destroy(alloc_, AsChunk(chunk)->Data() + i);
+    }
+    alloc_traits::deallocate(alloc_, AsChunk(chunk), 1);
+    chunk = next;
+  }
+  x_.next = &x_;
+  x_.prev = &x_;
+  size_ = 0;
+}
+
+template <typename T, typename Allocator, size_t K>
+void UnrolledList<T, Allocator, K>::Swap(UnrolledList& other) noexcept {
+  std::swap(x_.next, other.x_.next);
+  std::swap(x_.prev, other.x_.prev);
+  std::swap(size_, other.size_);
+  RelinkSentinel();
+  other.RelinkSentinel();
+  if (alloc_traits::propagate_on_container_swap::value) {
+    std::swap(alloc_, other.alloc_);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// AllocatorLock: serializes calls into an allocator that is shared between
+/// threads. The counting and stateful allocators are not thread-safe, so
+/// every allocator except std::allocator is guarded by a spin lock; for
+/// std::allocator lock and unlock compile to nothing.
+
+template <typename Allocator>
+class AllocatorLock {
+  public:
+  void lock() {
+    if constexpr (kNeeded) {
+      while (flag_.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void unlock() {
+    if constexpr (kNeeded) {
+      flag_.clear(std::memory_order_release);
+    }
+  }
+
+  private:
+  static constexpr bool kNeeded = !std::is_same_v<
+      Allocator, std::allocator<typename Allocator::value_type>>;
+  std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// MpscQueue: a multi-producer single-consumer queue. EmplaceBack may be
+/// called from any number of threads, TryPopFront and DrainTo only from one
+/// consumer thread at a time. Linking a node is a single atomic exchange, so
+/// producers never wait for each other or for the consumer while linking.
+/// Node allocation is not wait-free: with std::allocator it is whatever
+/// operator new is, and any other allocator is assumed not to be thread-safe,
+/// so its calls are serialized by a spin lock (see AllocatorLock) and
+/// producers may spin on it.
+
+template <typename T, typename Allocator = std::allocator<T>>
+class MpscQueue {
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+
+  explicit MpscQueue(const Allocator& alloc = Allocator());
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  ~MpscQueue();
+
+  [[nodiscard]] allocator_type GetAllocator() const noexcept { return alloc_; }
+
+  // Producer side.
+  template <typename... Args>
+  void EmplaceBack(Args&&... args);
+
+  template <typename U>
+  void PushBack(U&& value);
+
+  // Consumer side.
+  [[nodiscard]] bool Empty() const;
+
+  bool TryPopFront(T& value);
+
+  // Moves every element published so far to the back of list and returns
+  // their number.
+  template <typename ListAllocator>
+  size_t DrainTo(List<T, ListAllocator>& list);
+
+  private:
+  struct NodeBase {
+    std::atomic<NodeBase*> next{nullptr};
+  };
+  struct Node;
+
+  // The consumer owns head_, which always points to an already consumed
+  // node (initially stub_); the first element lives in head_->next. A
+  // consumed node keeps its link alive, only its value is destroyed.
+  NodeBase stub_;
+  NodeBase* head_ = &stub_;
+  std::atomic<NodeBase*> tail_{&stub_};
+
+  using alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Node>;
+  using alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Node>;
+  alloc_type alloc_;
+
+  AllocatorLock<Allocator> alloc_lock_;
+
+  void DestroyValue(Node* node);
+
+  void FreeNode(NodeBase* node);
+};
+
+template <typename T, typename Allocator>
+struct MpscQueue<T, Allocator>::Node : NodeBase {
+  template <typename... Args>
+  explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+  T value;
+};
+
+template <typename T, typename Allocator>
+MpscQueue<T, Allocator>::MpscQueue(const Allocator& alloc) : alloc_(alloc) {}
+
+template <typename T, typename Allocator>
+MpscQueue<T, Allocator>::~MpscQueue() {
+  NodeBase* node = head_->next.load(std::memory_order_acquire);
+  while (node != nullptr) {
+    NodeBase* next = node->next.load(std::memory_order_acquire);
+    DestroyValue(static_cast<Node*>(node));
+    FreeNode(head_);
+    head_ = node;
+    node = next;
+  }
+  FreeNode(head_);
+}
+
+template <typename T, typename Allocator>
+void MpscQueue<T, Allocator>::DestroyValue(Node* node) {
+  std::lock_guard<AllocatorLock<Allocator>> lock(alloc_lock_);
+  alloc_traits::destroy(alloc_, std::addressof(node->value));
+}
+
+// Frees the storage of an already destroyed node.
+template <typename T, typename Allocator>
+void MpscQueue<T, Allocator>::FreeNode(NodeBase* node) {
+  if (node == &stub_) {
+    return;
+  }
+  std::lock_guard<AllocatorLock<Allocator>> lock(alloc_lock_);
+  alloc_traits::deallocate(alloc_, static_cast<Node*>(node), 1);
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+void MpscQueue<T, Allocator>::EmplaceBack(Args&&... args) {
+  Node* node;
+  {
+    std::lock_guard<AllocatorLock<Allocator>> lock(alloc_lock_);
+    node = alloc_traits::allocate(alloc_, 1);
+    try {
+      alloc_traits::construct(alloc_, node, std::forward<Args>(args)...);
+    } catch (...) {
+      alloc_traits::deallocate(alloc_, node, 1);
+      throw;
+    }
+  }
+  NodeBase* prev = tail_.exchange(node, std::memory_order_acq_rel);
+  prev->next.store(node, std::memory_order_release);
+}
+
+template <typename T, typename Allocator>
+template <typename U>
+void MpscQueue<T, Allocator>::PushBack(U&& value) {
+  EmplaceBack(std::forward<U>(value));
+}
+
+template <typename T, typename Allocator>
+bool MpscQueue<T, Allocator>::Empty() const {
+  return head_->next.load(std::memory_order_acquire) == nullptr;
+}
+
+template <typename T, typename Allocator>
+bool MpscQueue<T, Allocator>::TryPopFront(T& value) {
+  NodeBase* next = head_->next.load(std::memory_order_acquire);
+  if (next == nullptr) {
+    return false;
+  }
+  Node* node = static_cast<Node*>(next);
+  value = std::move(node->value);
+  DestroyValue(node);
+  FreeNode(head_);
+  head_ = next;
+  return true;
+}
+
+template <typename T, typename Allocator>
+template <typename ListAllocator>
+size_t MpscQueue<T, Allocator>::DrainTo(List<T, ListAllocator>& list) {
+  size_t drained = 0;
+  NodeBase* next = head_->next.load(std::memory_order_acquire);
+  while (next != nullptr) {
+    Node* node = static_cast<Node*>(next);
+    list.EmplaceBack(std::move(node->value));
+    DestroyValue(node);
+    FreeNode(head_);
+    head_ = next;
+    ++drained;
+    next = head_->next.load(std::memory_order_acquire);
+  }
+  return drained;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// ConcurrentList: a singly linked list that many threads may modify at
+/// arbitrary positions at once. Traversal takes no locks: an operation finds
+/// its position optimistically, then locks only the node before it and the
+/// node at it and checks that both are still linked and adjacent, starting
+/// over if not. An erased node is marked under its lock before it is
+/// unlinked, which is what the check looks at. Threads working in different
+/// parts of the list therefore do not wait for each other's locks. Positions
+/// are given by predicates on the elements; a predicate may be called more
+/// than once per element and on elements being erased by another thread.
+///
+/// Apart from EmplaceFront and EmplaceBack (which starts from a tail hint),
+/// every operation searches from the front, so it costs O(position) and
+/// threads working far from the front all read the nodes before their
+/// region. Disjoint regions scale only as far as that shared, lock free
+/// walk allows; keep hot regions near the front or the list short.
+///
+/// Since readers hold no locks, an unlinked node is not freed right away.
+/// Every operation runs inside an epoch, and a node retired in epoch e is
+/// freed once the epoch has moved past e + 1, which only happens when no
+/// operation that entered by e is still running, see Retire.
+
+template <typename T, typename Allocator = std::allocator<T>>
+class ConcurrentList {
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+
+  explicit ConcurrentList(const Allocator& alloc = Allocator());
+
+  ConcurrentList(const ConcurrentList&) = delete;
+  ConcurrentList& operator=(const ConcurrentList&) = delete;
+
+  ~ConcurrentList();
+
+  [[nodiscard]] size_t Size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] bool Empty() const { return Size() == 0; }
+  [[nodiscard]] allocator_type GetAllocator() const noexcept { return alloc_; }
+
+  template <typename... Args>
+  void EmplaceFront(Args&&... args);
+
+  // O(1) unless it races with other appends or erases at the back: the walk
+  // starts at the last node the list knows of.
+  template <typename... Args>
+  void EmplaceBack(Args&&... args);
+
+  // Inserts before the first element satisfying pred, or at the back if
+  // there is none. O(position).
+  template <typename Pred, typename... Args>
+  void EmplaceBefore(Pred pred, Args&&... args);
+
+  // Erases the first element satisfying pred. Returns whether one was found.
+  template <typename Pred>
+  bool EraseIf(Pred pred);
+
+  bool Erase(const T& value);
+
+  // Copies the first element satisfying pred to value. Takes no locks.
+  template <typename Pred>
+  bool FindIf(Pred pred, T& value) const;
+
+  // Takes no locks.
+  [[nodiscard]] bool Contains(const T& value) const;
+
+  // Calls f on every element while holding its lock.
+  template <typename F>
+  void ForEach(F f) const;
+
+  private:
+  struct NodeBase {
+    std::mutex mutex;
+    std::atomic<NodeBase*> next{nullptr};
+    // Set under the lock of the node right before it is unlinked.
+    std::atomic<bool> marked{false};
+    // Chains retired nodes.
+    NodeBase* retired_next = nullptr;
+  };
+  struct Node;
+  // Keeps the calling operation in its epoch for the guard's lifetime.
+  class EpochGuard;
+
+  static constexpr size_t kEpochs = 3;
+
+  NodeBase head_;
+  std::atomic<size_t> size_{0};
+  // The last node, or close to it. It is only set while holding the lock of
+  // the predecessor of the node it is set to, and an erase moves it off the
+  // erased node before unlocking, so it never points to a retired node.
+  std::atomic<NodeBase*> tail_{&head_};
+
+  // The current epoch and, per epoch modulo kEpochs, the operations that
+  // entered it and the nodes retired during it.
+  mutable std::atomic<uint64_t> epoch_{0};
+  mutable std::atomic<size_t> active_[kEpochs] = {};
+  std::mutex retired_mutex_;
+  NodeBase* retired_[kEpochs] = {};
+
+  using alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Node>;
+  using alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Node>;
+  alloc_type alloc_;
+  AllocatorLock<Allocator> alloc_lock_;
+
+  template <typename... Args>
+  Node* MakeNode(Args&&... args);
+
+  void FreeNode(Node* node);
+
+  // Frees node and the nodes after it, following next or retired_next.
+  void FreeChain(NodeBase* node);
+  void FreeRetired(NodeBase* node);
+
+  // Hands over a node unlinked by the caller, which must have left its
+  // epoch. Moves the epoch on if the one before the current is over and
+  // frees what was retired in it.
+  void Retire(NodeBase* node);
+
+  // Finds the first element satisfying pred without locking (starting at
+  // tail_ if from_tail), then locks it and its predecessor and validates
+  // them, retrying until that succeeds. Returns the locked predecessor; its
+  // successor (the match, or nullptr) is locked too.
+  template <typename Pred>
+  NodeBase* LockBefore(Pred& pred, bool from_tail = false);
+
+  // Links node after the locked prev returned by LockBefore and unlocks.
+  void LinkAfter(NodeBase* prev, Node* node);
+
+  // The first unmarked node whose element satisfies pred, or nullptr.
+  template <typename Pred>
+  const Node* Find(Pred& pred) const;
+};
+
+template <typename T, typename Allocator>
+struct ConcurrentList<T, Allocator>::Node : NodeBase {
+  template <typename... Args>
+  explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+  T value;
+};
+
+template <typename T, typename Allocator>
+class ConcurrentList<T, Allocator>::EpochGuard {
+  public:
+  explicit EpochGuard(const ConcurrentList& list) : list_(list) {
+    // Registering in an epoch that has just ended would not hold off its
+    // reclamation, so check that it is still current.
+    while (true) {
+      epoch_ = list_.epoch_.load();
+      list_.active_[epoch_ % kEpochs].fetch_add(1);
+      if (list_.epoch_.load() == epoch_) {
+        return;
+      }
+      list_.active_[epoch_ % kEpochs].fetch_sub(1);
+    }
+  }
+
+  EpochGuard(const EpochGuard&) = delete;
+  EpochGuard& operator=(const EpochGuard&) = delete;
+
+  ~EpochGuard() { list_.active_[epoch_ % kEpochs].fetch_sub(1); }
+
+  private:
+  const ConcurrentList& list_;
+  uint64_t epoch_;
+};
+
+template <typename T, typename Allocator>
+ConcurrentList<T, Allocator>::ConcurrentList(const Allocator& alloc)
+    : alloc_(alloc) {}
+
+template <typename T, typename Allocator>
+ConcurrentList<T, Allocator>::~ConcurrentList() {
+  FreeChain(head_.next.load(std::memory_order_relaxed));
+  for (NodeBase* retired : retired_) {
+    FreeRetired(retired);
+  }
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+typename ConcurrentList<T, Allocator>::Node*
+ConcurrentList<T, Allocator>::MakeNode(Args&&... args) {
+  std::lock_guard<AllocatorLock<Allocator>> lock(alloc_lock_);
+  Node* node = alloc_traits::allocate(alloc_, 1);
+  try {
+    alloc_traits::construct(alloc_, node, std::forward<Args>(args)...);
+  } catch (...) {
+    alloc_traits::deallocate(alloc_, node, 1);
+    throw;
+  }
+  return node;
+}
+
+template <typename T, typename Allocator>
+void ConcurrentList<T, Allocator>::FreeNode(Node* node) {
+  std::lock_guard<AllocatorLock<Allocator>> lock(alloc_lock_);
+  alloc_traits::destroy(alloc_, node);
+  alloc_traits::deallocate(alloc_, node, 1);
+}
+
+template <typename T, typename Allocator>
+void ConcurrentList<T, Allocator>::FreeChain(NodeBase* node) {
+  while (node != nullptr) {
+    NodeBase* next = node->next.load(std::memory_order_relaxed);
+    FreeNode(static_cast<Node*>(node));
+    node = next;
+  }
+}
+
+template <typename T, typename Allocator>
+void ConcurrentList<T, Allocator>::FreeRetired(NodeBase* node) {
+  while (node != nullptr) {
+    NodeBase* next = node->retired_next;
+    FreeNode(static_cast<Node*>(node));
+    node = next;
+  }
+}
+
+template <typename T, typename Allocator>
+void ConcurrentList<T, Allocator>::Retire(NodeBase* node) {
+  NodeBase* reclaimed = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    uint64_t epoch = epoch_.load();
+    node->retired_next = retired_[epoch % kEpochs];
+    retired_[epoch % kEpochs] = node;
+    // Operations of epochs before the previous one are over already, so if
+    // the previous one is over too, nobody can still reach its nodes.
+    size_t previous = (epoch + kEpochs - 1) % kEpochs;
+    if (active_[previous].load() == 0) {
+      reclaimed = retired_[previous];
+      retired_[previous] = nullptr;
+      epoch_.store(epoch + 1);
+    }
+  }
+  FreeRetired(reclaimed);
+}
+
+template <typename T, typename Allocator>
+template <typename Pred>
+typename ConcurrentList<T, Allocator>::NodeBase*
+ConcurrentList<T, Allocator>::LockBefore(Pred& pred, bool from_tail) {
+  while (true) {
+    NodeBase* prev =
+        from_tail ? tail_.load(std::memory_order_acquire) : &head_;
+    NodeBase* current = prev->next.load(std::memory_order_acquire);
+    while (current != nullptr &&
+           !pred(static_cast<const Node*>(current)->value)) {
+      prev = current;
+      current = current->next.load(std::memory_order_acquire);
+    }
+    prev->mutex.lock();
+    if (current != nullptr) {
+      current->mutex.lock();
+    }
+    // Links and marks only change under the locks held here.
+    if (!prev->marked.load(std::memory_order_relaxed) &&
+        prev->next.load(std::memory_order_relaxed) == current &&
+        (current == nullptr ||
+         !current->marked.load(std::memory_order_relaxed))) {
+      return prev;
+    }
+    if (current != nullptr) {
+      current->mutex.unlock();
+    }
+    prev->mutex.unlock();
+  }
+}
+
+template <typename T, typename Allocator>
+template <typename Pred>
+const typename ConcurrentList<T, Allocator>::Node*
+ConcurrentList<T, Allocator>::Find(Pred& pred) const {
+  const NodeBase* current = head_.next.load(std::memory_order_acquire);
+  while (current != nullptr) {
+    const Node* node = static_cast<const Node*>(current);
+    if (!node->marked.load(std::memory_order_acquire) && pred(node->value)) {
+      return node;
+    }
+    current = current->next.load(std::memory_order_acquire);
+  }
+  return nullptr;
+}
+
+template <typename T, typename Allocator>
+void ConcurrentList<T, Allocator>::LinkAfter(NodeBase* prev, Node* node) {
+  NodeBase* current = prev->next.load(std::memory_order_relaxed);
+  node->next.store(current, std::memory_order_relaxed);
+  prev->next.store(node, std::memory_order_release);
+  if (current == nullptr) {
+    tail_.store(node, std::memory_order_release);
+  }
+  size_.fetch_add(1, std::memory_order_relaxed);
+  if (current != nullptr) {
+    current->mutex.unlock();
+  }
+  prev->mutex.unlock();
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+void ConcurrentList<T, Allocator>::EmplaceFront(Args&&... args) {
+  Node* node = MakeNode(std::forward<Args>(args)...);
+  std::lock_guard<std::mutex> lock(head_.mutex);
+  NodeBase* current = head_.next.load(std::memory_order_relaxed);
+  node->next.store(current, std::memory_order_relaxed);
+  head_.next.store(node, std::memory_order_release);
+  if (current == nullptr) {
+    tail_.store(node, std::memory_order_release);
+  }
+  size_.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+void ConcurrentList<T, Allocator>::EmplaceBack(Args&&... args) {
+  Node* node = MakeNode(std::forward<Args>(args)...);
+  auto never = [](const T&) { return false; };
+  EpochGuard guard(*this);
+  LinkAfter(LockBefore(never, true), node);
+}
+
+template <typename T, typename Allocator>
+template <typename Pred, typename... Args>
+void ConcurrentList<T, Allocator>::EmplaceBefore(Pred pred, Args&&... args) {
+  Node* node = MakeNode(std::forward<Args>(args)...);
+  EpochGuard guard(*this);
+  NodeBase* prev;
+  try {
+    prev = LockBefore(pred);
+  } catch (...) {
+    FreeNode(node);
+    throw;
+  }
+  LinkAfter(prev, node);
+}
+
+template <typename T, typename Allocator>
+template <typename Pred>
+bool ConcurrentList<T, Allocator>::EraseIf(Pred pred) {
+  NodeBase* current;
+  {
+    EpochGuard guard(*this);
+    NodeBase* prev = LockBefore(pred);
+    current = prev->next.load(std::memory_order_relaxed);
+    if (current == nullptr) {
+      prev->mutex.unlock();
+      return false;
+    }
+    current->marked.store(true, std::memory_order_release);
+    NodeBase* last = current;
+    tail_.compare_exchange_strong(last, prev);
+    prev->next.store(current->next.load(std::memory_order_relaxed),
+                     std::memory_order_release);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    current->mutex.unlock();
+    prev->mutex.unlock();
+  }
+  Retire(current);
+  return true;
+}
+
+template <typename T, typename Allocator>
+bool ConcurrentList<T, Allocator>::Erase(const T& value) {
+  return EraseIf([&value](const T& element) { return element == value; });
+}
+
+template <typename T, typename Allocator>
+template <typename Pred>
+bool ConcurrentList<T, Allocator>::FindIf(Pred pred, T& value) const {
+  EpochGuard guard(*this);
+  const Node* node = Find(pred);
+  if (node == nullptr) {
+    return false;
+  }
+  value = node->value;
+  return true;
+}
+
+template <typename T, typename Allocator>
+bool ConcurrentList<T, Allocator>::Contains(const T& value) const {
+  auto equal = [&value](const T& element) { return element == value; };
+  EpochGuard guard(*this);
+  return Find(equal) != nullptr;
+}
+
+template <typename T, typename Allocator>
+template <typename F>
+void ConcurrentList<T, Allocator>::ForEach(F f) const {
+  EpochGuard guard(*this);
+  NodeBase* current = head_.next.load(std::memory_order_acquire);
+  while (current != nullptr) {
+    std::lock_guard<std::mutex> lock(current->mutex);
+    if (!current->marked.load(std::memory_order_relaxed)) {
+      f(static_cast<const Node*>(current)->value);
+    }
+    current = current->next.load(std::memory_order_acquire);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// XorList: a compact doubly linked list where every node keeps a single
+/// link, prev ^ next, instead of two pointers. The sentinel is stored in the
+/// object (its link is head ^ tail), so both ends are still O(1). Iterators
+/// carry the node and its predecessor; inserting or erasing next to an
+/// iterator invalidates it.
+
+template <typename T, typename Allocator = std::allocator<T>>
+class XorList {
+  template <bool is_const>
+  class XorIterator;
+
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using iterator = XorIterator<false>;
+  using const_iterator = XorIterator<true>;
+
+  XorList() = default;
+
+  explicit XorList(size_t count, const T& value,
+                   const Allocator& alloc = Allocator());
+
+  explicit XorList(size_t count, const Allocator& alloc = Allocator());
+
+  XorList(const XorList& other);
+
+  XorList(const XorList& other, const Allocator& alloc);
+
+  XorList(XorList&& other) noexcept;
+
+  XorList(std::initializer_list<value_type> init,
+          const Allocator& alloc = Allocator());
+
+  ~XorList();
+
+  XorList& operator=(const XorList& other);
+  XorList& operator=(XorList&& other) noexcept(
+      std::allocator_traits<
+          Allocator>::propagate_on_container_move_assignment::value ||
+      std::allocator_traits<Allocator>::is_always_equal::value);
+
+  [[nodiscard]] size_t Size() const { return size_; }
+
+  [[nodiscard]] bool Empty() const { return size_ == 0; }
+  [[nodiscard]] allocator_type GetAllocator() const noexcept { return alloc_; }
+
+  [[nodiscard]] iterator Begin() const;
+  [[nodiscard]] const_iterator Cbegin() const;
+  [[nodiscard]] iterator End() const;
+  [[nodiscard]] const_iterator Cend() const;
+
+  value_type& Front();
+  [[nodiscard]] const value_type& Front() const;
+  value_type& Back();
+  [[nodiscard]] const value_type& Back() const;
+
+  template <typename... Args>
+  void EmplaceBack(Args&&... args);
+
+  template <typename... Args>
+  void EmplaceFront(Args&&... args);
+
+  template <typename U>
+  void PushBack(U&& value);
+
+  template <typename U>
+  void PushFront(U&& value);
+
+  void PopBack();
+  void PopFront();
+
+  void Clear();
+
+  void Swap(XorList& other) noexcept;
+
+  private:
+  struct NodeBase {
+    uintptr_t link;
+  };
+  struct Node;
+
+  mutable NodeBase x_{0};
+  NodeBase* head_ = &x_;
+  NodeBase* tail_ = &x_;
+  size_t size_ = 0;
+
+  using alloc_traits = typename std::allocator_traits<
+      allocator_type>::template rebind_traits<Node>;
+  using alloc_type = typename std::allocator_traits<
+      allocator_type>::template rebind_alloc<Node>;
+  alloc_type alloc_;
+
+  static uintptr_t Address(const NodeBase* node) {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  // The neighbour of node which is not neighbour.
+  static NodeBase* Other(const NodeBase* node, const NodeBase* neighbour) {
+    return reinterpret_cast<NodeBase*>(node->link ^ Address(neighbour));
+  }
+
+  static T& Value(NodeBase* node) { return static_cast<Node*>(node)->value; }
+
+  template <typename... Args>
+  Node* MakeNode(Args&&... args);
+
+  // Links node between the adjacent left and right.
+  static void LinkBetween(NodeBase* left, NodeBase* node, NodeBase* right);
+
+  // Unlinks node from its neighbours left and right.
+  static void Unlink(NodeBase* left, NodeBase* node, NodeBase* right);
+
+  void StealChain(XorList& other);
+};
+
+template <typename T, typename Allocator>
+struct XorList<T, Allocator>::Node : NodeBase {
+  template <typename... Args>
+  explicit Node(Args&&... args) : NodeBase{0}, value(std::forward<Args>(args)...) {}
+
+  T value;
+};
+
+template <typename T, typename Allocator>
+template <bool is_const>
+class XorList<T, Allocator>::XorIterator {
+  friend class XorList<T, Allocator>;
+
+  public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const T*, T*>;
+  using reference = std::conditional_t<is_const, const T&, T&>;
+
+  XorIterator(NodeBase* prev, NodeBase* node) : prev_(prev), node_(node) {}
+
+  reference operator*() const { return Value(node_); }
+
+  pointer operator->() const { return &Value(node_); }
+
+  XorIterator& operator++() {
+    NodeBase* next = Other(node_, prev_);
+    prev_ = node_;
+    node_ = next;
+    return *this;
+  }
+
+  XorIterator& operator--() {
+    NodeBase* prev = Other(prev_, node_);
+    node_ = prev_;
+    prev_ = prev;
+    return *this;
+  }
+
+  bool operator==(const XorIterator& other) const {
+    return node_ == other.node_;
+  }
+
+  bool operator!=(const XorIterator& other) const {
+    return node_ != other.node_;
+  }
+
+  private:
+  NodeBase* prev_;
+  NodeBase* node_;
+};
+
+template <typename T, typename Allocator>
+template <typename... Args>
+typename XorList<T, Allocator>::Node* XorList<T, Allocator>::MakeNode(
+    Args&&... args) {
+  Node* node = alloc_traits::allocate(alloc_, 1);
+  try {
+    alloc_traits::construct(alloc_, node, std::forward<Args>(args)...);
+  } catch (...) {
+    alloc_traits::deallocate(alloc_, node, 1);
+    throw;
+  }
+  return node;
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::LinkBetween(NodeBase* left, NodeBase* node,
+                                        NodeBase* right) {
+  node->link = Address(left) ^ Address(right);
+  left->link ^= Address(right) ^ Address(node);
+  right->link ^= Address(left) ^ Address(node);
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::Unlink(NodeBase* left, NodeBase* node,
+                                   NodeBase* right) {
+  left->link ^= Address(node) ^ Address(right);
+  right->link ^= Address(node) ^ Address(left);
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::StealChain(XorList& other) {
+  size_ = other.size_;
+  if (other.Empty()) {
+    head_ = &x_;
+    tail_ = &x_;
+    x_.link = 0;
+    return;
+  }
+  uintptr_t moved = Address(&other.x_) ^ Address(&x_);
+  head_ = other.head_;
+  tail_ = other.tail_;
+  x_.link = other.x_.link;
+  head_->link ^= moved;
+  tail_->link ^= moved;
+  other.head_ = &other.x_;
+  other.tail_ = &other.x_;
+  other.x_.link = 0;
+  other.size_ = 0;
+}
+
+/// -------------------------------Constructors---------------------------------
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(size_t count, const T& value,
+                               const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      EmplaceBack(value);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(size_t count, const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (size_t i = 0; i < count; ++i) {
+      EmplaceBack();
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(const XorList& other)
+    : XorList(other, std::allocator_traits<Allocator>::
+                         select_on_container_copy_construction(
+                             other.GetAllocator())) {}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(const XorList& other, const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (auto it = other.Cbegin(); it != other.Cend(); ++it) {
+      EmplaceBack(*it);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(XorList&& other) noexcept
+    : alloc_(std::move(other.alloc_)) {
+  StealChain(other);
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::XorList(std::initializer_list<value_type> init,
+                               const Allocator& alloc)
+    : alloc_(alloc) {
+  try {
+    for (auto iter = init.begin(); iter != init.end(); ++iter) {
+      EmplaceBack(*iter);
+    }
+  } catch (...) {
+    Clear();
+    throw;
+  }
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>::~XorList() {
+  Clear();
+}
+
+/// -------------------------------Operators------------------------------------
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>& XorList<T, Allocator>::operator=(const XorList& other) {
+  if (this == &other) {
+    return *this;
+  }
+  Allocator alloc = std::allocator_traits<
+                        Allocator>::propagate_on_container_copy_assignment::value
+                        ? other.GetAllocator()
+                        : GetAllocator();
+  XorList tmp(other, alloc);
+  Clear();
+  alloc_ = tmp.alloc_;
+  StealChain(tmp);
+  return *this;
+}
+
+template <typename T, typename Allocator>
+XorList<T, Allocator>& XorList<T, Allocator>::operator=(
+    XorList&& other) noexcept(std::allocator_traits<Allocator>::
+                                  propagate_on_container_move_assignment::
+                                      value ||
+                              std::allocator_traits<
+                                  Allocator>::is_always_equal::value) {
+  if (this == &other) {
+    return *this;
+  }
+  Clear();
+  if (alloc_traits::propagate_on_container_move_assignment::value) {
+    alloc_ = std::move(other.alloc_);
+    StealChain(other);
+  } else if (alloc_ == other.alloc_) {
+    StealChain(other);
+  } else {
+    for (auto it = other.Begin(); it != other.End(); ++it) {
+      EmplaceBack(std::move(*it));
+    }
+    other.Clear();
+  }
+  return *this;
+}
+
+/// -------------------------------Iterators------------------------------------
+
+template <typename T, typename Allocator>
+typename XorList<T, Allocator>::iterator XorList<T, Allocator>::Begin() const {
+  return iterator(&x_, head_);
+}
+
+template <typename T, typename Allocator>
+typename XorList<T, Allocator>::const_iterator XorList<T, Allocator>::Cbegin()
+    const {
+  return const_iterator(&x_, head_);
+}
+
+template <typename T, typename Allocator>
+typename XorList<T, Allocator>::iterator XorList<T, Allocator>::End() const {
+  return iterator(tail_, &x_);
+}
+
+template <typename T, typename Allocator>
+typename XorList<T, Allocator>::const_iterator XorList<T, Allocator>::Cend()
+    const {
+  return const_iterator(tail_, &x_);
+}
+
+/// -----------------------Element access methods-------------------------------
+
+template <typename T, typename Allocator>
+T& XorList<T, Allocator>::Front() {
+  return Value(head_);
+}
+
+template <typename T, typename Allocator>
+const T& XorList<T, Allocator>::Front() const {
+  return Value(head_);
+}
+
+template <typename T, typename Allocator>
+T& XorList<T, Allocator>::Back() {
+  return Value(tail_);
+}
+
+template <typename T, typename Allocator>
+const T& XorList<T, Allocator>::Back() const {
+  return Value(tail_);
+}
+
+/// ------------------------------Modifiers-------------------------------------
+
+template <typename T, typename Allocator>
+template <typename... Args>
+void XorList<T, Allocator>::EmplaceBack(Args&&... args) {
+  Node* node = MakeNode(std::forward<Args>(args)...);
+  LinkBetween(tail_, node, &x_);
+  if (Empty()) {
+    head_ = node;
+  }
+  tail_ = node;
+  ++size_;
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+void XorList<T, Allocator>::EmplaceFront(Args&&... args) {
+  Node* node = MakeNode(std::forward<Args>(args)...);
+  LinkBetween(&x_, node, head_);
+  if (Empty()) {
+    tail_ = node;
+  }
+  head_ = node;
+  ++size_;
+}
+
+template <typename T, typename Allocator>
+template <typename U>
+void XorList<T, Allocator>::PushBack(U&& value) {
+  EmplaceBack(std::forward<U>(value));
+}
+
+template <typename T, typename Allocator>
+template <typename U>
+void XorList<T, Allocator>::PushFront(U&& value) {
+  EmplaceFront(std::forward<U>(value));
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::PopBack() {
+  if (Empty()) {
+    return;
+  }
+  NodeBase* old_tail = tail_;
+  NodeBase* prev = Other(old_tail, &x_);
+  Unlink(prev, old_tail, &x_);
+  tail_ = prev;
+  --size_;
+  if (Empty()) {
+    head_ = &x_;
+  }
+  alloc_traits::destroy(alloc_, static_cast<Node*>(old_tail));
+  alloc_traits::deallocate(alloc_, static_cast<Node*>(old_tail), 1);
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::PopFront() {
+  if (Empty()) {
+    return;
+  }
+  NodeBase* old_head = head_;
+  NodeBase* next = Other(old_head, &x_);
+  Unlink(&x_, old_head, next);
+  head_ = next;
+  --size_;
+  if (Empty()) {
+    tail_ = &x_;
+  }
+  alloc_traits::destroy(alloc_, static_cast<Node*>(old_head));
+  alloc_traits::deallocate(alloc_, static_cast<Node*>(old_head), 1);
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::Clear() {
+  NodeBase* prev = &x_;
+  NodeBase* node = head_;
+  while (node != &x_) {
+    NodeBase* next = Other(node, prev);
+    alloc_traits::destroy(alloc_, static_cast<Node*>(node));
+    alloc_traits::deallocate(alloc_, static_cast<Node*>(node), 1);
+    prev = node;
+    node = next;
+  }
+  head_ = &x_;
+  tail_ = &x_;
+  x_.link = 0;
+  size_ = 0;
+}
+
+template <typename T, typename Allocator>
+void XorList<T, Allocator>::Swap(XorList& other) noexcept {
+  if (this == &other) {
+    return;
+  }
+  // The end nodes link to the sentinel of their list, rebase them as in
+  // StealChain. A single node links to it twice, which cancels out.
+  uintptr_t moved = Address(&other.x_) ^ Address(&x_);
+  if (!Empty()) {
+    head_->link ^= moved;
+    tail_->link ^= moved;
+  }
+  if (!other.Empty()) {
+    other.head_->link ^= moved;
+    other.tail_->link ^= moved;
+  }
+  std::swap(head_, other.head_);
+  std::swap(tail_, other.tail_);
+  std::swap(x_.link, other.x_.link);
+  std::swap(size_, other.size_);
+  if (Empty()) {
+    head_ = &x_;
+    tail_ = &x_;
+  }
+  if (other.Empty()) {
+    other.head_ = &other.x_;
+    other.tail_ = &other.x_;
+  }
+  if (alloc_traits::propagate_on_container_swap::value) {
+    std::swap(alloc_, other.alloc_);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// IntrusiveList: links objects through a ListHook embedded in them instead
+/// of copying them into nodes, so linking and unlinking never allocate. The
+/// list keeps the sentinel ring of List, with the sentinel hook stored in the
+/// list object. Objects must stay alive while they are linked; copying an
+/// object does not copy its links. A hook remembers the object it was linked
+/// for, so getting from a hook back to its object needs no layout tricks and
+/// works for any T.
+
+struct ListHook {
+  ListHook() = default;
+  ListHook(const ListHook& /*other*/) {}
+  ListHook& operator=(const ListHook& /*other*/) { return *this; }
+
+  [[nodiscard]] bool Linked() const { return next != nullptr; }
+
+  ListHook* next = nullptr;
+  ListHook* prev = nullptr;
+  void* owner = nullptr;
+};
+
+template <typename T, ListHook T::*Hook>
+class IntrusiveList {
+  template <bool is_const>
+  class IntrusiveIterator;
+
+  public:
+  using value_type = T;
+  using iterator = IntrusiveIterator<false>;
+  using const_iterator = IntrusiveIterator<true>;
+
+  IntrusiveList();
+
+  IntrusiveList(const IntrusiveList& other) = delete;
+
+  IntrusiveList(IntrusiveList&& other) noexcept;
+
+  ~IntrusiveList();
+
+  IntrusiveList& operator=(const IntrusiveList& other) = delete;
+  IntrusiveList& operator=(IntrusiveList&& other) noexcept;
+
+  [[nodiscard]] size_t Size() const { return size_; }
+
+  [[nodiscard]] bool Empty() const { return size_ == 0; }
+
+  [[nodiscard]] iterator Begin() const;
+  [[nodiscard]] const_iterator Cbegin() const;
+  [[nodiscard]] iterator End() const;
+  [[nodiscard]] const_iterator Cend() const;
+
+  // Iterator to value, which must be linked into this list.
+  [[nodiscard]] iterator IteratorTo(T& value) const;
+
+  T& Front();
+  [[nodiscard]] const T& Front() const;
+  T& Back();
+  [[nodiscard]] const T& Back() const;
+
+  void PushBack(T& value);
+  void PushFront(T& value);
+
+  void PopBack();
+  void PopFront();
+
+  // Unlinks value, which must be linked into this list, in O(1).
+  void Erase(T& value);
+
+  // Unlinks every object.
+  void Clear();
+
+  void Swap(IntrusiveList& other) noexcept;
+
+  private:
+  mutable ListHook x_;
+  size_t size_ = 0;
+
+  static ListHook* HookOf(T& value) { return &(value.*Hook); }
+
+  static T* ObjectOf(ListHook* hook) { return static_cast<T*>(hook->owner); }
+
+  // Links value's hook before position and records value as its owner.
+  static void LinkBefore(ListHook* position, T& value);
+
+  static void Unlink(ListHook* hook);
+
+  void ResetEnds() {
+    x_.next = &x_;
+    x_.prev = &x_;
+  }
+
+  void StealRing(IntrusiveList& other);
+};
+
+template <typename T, ListHook T::*Hook>
+template <bool is_const>
+class IntrusiveList<T, Hook>::IntrusiveIterator {
+  friend class IntrusiveList<T, Hook>;
+
+  public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const T*, T*>;
+  using reference = std::conditional_t<is_const, const T&, T&>;
+
+  explicit IntrusiveIterator(ListHook* hook) : hook_(hook) {}
+
+  reference operator*() const { return *ObjectOf(hook_); }
+
+  pointer operator->() const { return ObjectOf(hook_); }
+
+  IntrusiveIterator& operator++() {
+    hook_ = hook_->next;
+    return *this;
+  }
+
+  IntrusiveIterator& operator--() {
+    hook_ = hook_->prev;
+    return *this;
+  }
+
+  bool operator==(const IntrusiveIterator& other) const {
+    return hook_ == other.hook_;
+  }
+
+  bool operator!=(const IntrusiveIterator& other) const {
+    return hook_ != other.hook_;
+  }
+
+  private:
+  ListHook* hook_;
+};
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::LinkBefore(ListHook* position, T& value) {
+  ListHook* hook = HookOf(value);
+  hook->owner = &value;
+  hook->next = position;
+  hook->prev = position->prev;
+  position->prev->next = hook;
+  position->prev = hook;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::Unlink(ListHook* hook) {
+  hook->prev->next = hook->next;
+  hook->next->prev = hook->prev;
+  hook->next = nullptr;
+  hook->prev = nullptr;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::StealRing(IntrusiveList& other) {
+  size_ = other.size_;
+  if (other.Empty()) {
+    ResetEnds();
+    return;
+  }
+  x_.next = other.x_.next;
+  x_.prev = other.x_.prev;
+  x_.next->prev = &x_;
+  x_.prev->next = &x_;
+  other.ResetEnds();
+  other.size_ = 0;
+}
+
+/// -------------------------------Constructors---------------------------------
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>::IntrusiveList() {
+  ResetEnds();
+}
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>::IntrusiveList(IntrusiveList&& other) noexcept {
+  ResetEnds();
+  StealRing(other);
+}
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>::~IntrusiveList() {
+  Clear();
+}
+
+/// -------------------------------Operators------------------------------------
+
+template <typename T, ListHook T::*Hook>
+IntrusiveList<T, Hook>& IntrusiveList<T, Hook>::operator=(
+    IntrusiveList&& other) noexcept {
+  if (this != &other) {
+    Clear();
+    StealRing(other);
+  }
+  return *this;
+}
+
+/// -------------------------------Iterators------------------------------------
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::iterator IntrusiveList<T, Hook>::Begin()
+    const {
+  return iterator(x_.next);
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::const_iterator IntrusiveList<T, Hook>::Cbegin()
+    const {
+  return const_iterator(x_.next);
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::iterator IntrusiveList<T, Hook>::End() const {
+  return iterator(&x_);
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::const_iterator IntrusiveList<T, Hook>::Cend()
+    const {
+  return const_iterator(&x_);
+}
+
+template <typename T, ListHook T::*Hook>
+typename IntrusiveList<T, Hook>::iterator IntrusiveList<T, Hook>::IteratorTo(
+    T& value) const {
+  return iterator(HookOf(value));
+}
+
+/// -----------------------Element access methods-------------------------------
+
+template <typename T, ListHook T::*Hook>
+T& IntrusiveList<T, Hook>::Front() {
+  return *ObjectOf(x_.next);
+}
+
+template <typename T, ListHook T::*Hook>
+const T& IntrusiveList<T, Hook>::Front() const {
+  return *ObjectOf(x_.next);
+}
+
+template <typename T, ListHook T::*Hook>
+T& IntrusiveList<T, Hook>::Back() {
+  return *ObjectOf(x_.prev);
+}
+
+template <typename T, ListHook T::*Hook>
+const T& IntrusiveList<T, Hook>::Back() const {
+  return *ObjectOf(x_.prev);
+}
+
+/// ------------------------------Modifiers-------------------------------------
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::PushBack(T& value) {
+  LinkBefore(&x_, value);
+  ++size_;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::PushFront(T& value) {
+  LinkBefore(x_.next, value);
+  ++size_;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::PopBack() {
+  if (Empty()) {
+    return;
+  }
+  Unlink(x_.prev);
+  --size_;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::PopFront() {
+  if (Empty()) {
+    return;
+  }
+  Unlink(x_.next);
+  --size_;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::Erase(T& value) {
+  Unlink(HookOf(value));
+  --size_;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::Clear() {
+  ListHook* hook = x_.next;
+  while (hook != &x_) {
+    ListHook* next = hook->next;
+    hook->next = nullptr;
+    hook->prev = nullptr;
+    hook = next;
+  }
+  ResetEnds();
+  size_ = 0;
+}
+
+template <typename T, ListHook T::*Hook>
+void IntrusiveList<T, Hook>::Swap(IntrusiveList& other) noexcept {
+  IntrusiveList tmp(std::move(other));
+  other.StealRing(*this);
+  StealRing(tmp);
+}
+
+#if LIST_POSIX_IO
+////////////////////////////////////////////////////////////////////////////////
+/// PersistentList: a list of trivially copyable T that lives in a memory
+/// mapped file. Links are self-relative offsets (target address minus the
+/// address of the link), so the mapping can land at any address: opening an
+/// existing file is O(1) and the list is ready to use. Nodes are carved out
+/// of the mapping by a bump pointer and recycled through a free list; the
+/// file doubles when it is full. Growing remaps the file and invalidates
+/// iterators and references. Flush() writes the mapping back; a crash in
+/// the middle of a modification may leave the file inconsistent.
+
+template <typename T>
+class PersistentList {
+  template <bool is_const>
+  class PersistentIterator;
+
+  static_assert(std::is_trivially_copyable_v<T>,
+                "PersistentList stores its elements as raw bytes");
+
+  public:
+  using value_type = T;
+  using iterator = PersistentIterator<false>;
+  using const_iterator = PersistentIterator<true>;
+
+  static constexpr size_t kInitialFileBytes = 1 << 16;
+
+  // Opens the list stored at path, creating an empty one if the file does
+  // not exist or is empty. Throws std::system_error if the file can not be
+  // opened or mapped and std::runtime_error if it holds a list of another
+  // element type.
+  explicit PersistentList(const std::string& path,
+                          size_t initial_bytes = kInitialFileBytes);
+
+  PersistentList(const PersistentList&) = delete;
+  PersistentList& operator=(const PersistentList&) = delete;
+
+  ~PersistentList();
+
+  [[nodiscard]] size_t Size() const { return Meta().size; }
+
+  [[nodiscard]] bool Empty() const { return Size() == 0; }
+
+  // Size of the file and of the mapping.
+  [[nodiscard]] size_t MappedBytes() const { return mapped_bytes_; }
+
+  [[nodiscard]] iterator Begin() const;
+  [[nodiscard]] const_iterator Cbegin() const;
+  [[nodiscard]] iterator End() const;
+  [[nodiscard]] const_iterator Cend() const;
+
+  value_type& Front();
+  [[nodiscard]] const value_type& Front() const;
+  value_type& Back();
+  [[nodiscard]] const value_type& Back() const;
+
+  void PushBack(const T& value);
+  void PushFront(const T& value);
+
+  // Like List, popping an empty list does nothing.
+  void PopBack();
+  void PopFront();
+
+  // Moves every node to the free list; the file does not shrink.
+  void Clear();
+
+  // msync of the whole mapping.
+  void Flush();
+
+  private:
+  struct NodeBase {
+    std::ptrdiff_t next;
+    std::ptrdiff_t prev;
+  };
+
+  struct Node : NodeBase {
+    T value;
+  };
+
+  // Offsets in Header other than the links are from the start of the file.
+  struct Header {
+    uint64_t magic;
+    uint64_t node_size;
+    uint64_t size;
+    uint64_t used;
+    uint64_t free_list;
+    NodeBase sentinel;
+  };
+
+  static constexpr uint64_t kMagic = 0x31545350534c;  // "LSPST1"
+
+  static constexpr size_t kFirstNode =
+      (sizeof(Header) + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+
+  int fd_ = -1;
+  char* base_ = nullptr;
+  size_t mapped_bytes_ = 0;
+
+  Header& Meta() const { return *reinterpret_cast<Header*>(base_); }
+
+  NodeBase* Sentinel() const { return &Meta().sentinel; }
+
+  static NodeBase* Next(NodeBase* node) {
+    return reinterpret_cast<NodeBase*>(reinterpret_cast<char*>(node) +
+                                       node->next);
+  }
+
+  static NodeBase* Prev(NodeBase* node) {
+    return reinterpret_cast<NodeBase*>(reinterpret_cast<char*>(node) +
+                                       node->prev);
+  }
+
+  static std::ptrdiff_t Offset(const NodeBase* from, const NodeBase* to) {
+    return reinterpret_cast<const char*>(to) -
+           reinterpret_cast<const char*>(from);
+  }
+
+  static T& Value(NodeBase* node) { return static_cast<Node*>(node)->value; }
+
+  void Map(size_t bytes);
+
+  // Doubles the file (at least to bytes) and maps it again.
+  void Grow(size_t bytes);
+
+  // Takes a node from the free list or the end of the used area. May remap,
+  // so pointers into the mapping must be computed after it returns.
+  Node* AllocateNode();
+
+  void ReleaseNode(NodeBase* node);
+
+  static void LinkBefore(NodeBase* position, NodeBase* node);
+
+  static void Unlink(NodeBase* node);
+};
+
+template <typename T>
+template <bool is_const>
+class PersistentList<T>::PersistentIterator {
+  friend class PersistentList<T>;
+
+  public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const T*, T*>;
+  using reference = std::conditional_t<is_const, const T&, T&>;
+
+  explicit PersistentIterator(NodeBase* node) : node_(node) {}
+
+  reference operator*() const { return Value(node_); }
+
+  pointer operator->() const { return &Value(node_); }
+
+  PersistentIterator& operator++() {
+    node_ = Next(node_);
+    return *this;
+  }
+
+  PersistentIterator& operator--() {
+    node_ = Prev(node_);
+    return *this;
+  }
+
+  bool operator==(const PersistentIterator& other) const {
+    return node_ == other.node_;
+  }
+
+  bool operator!=(const PersistentIterator& other) const {
+    return node_ != other.node_;
+  }
+
+  private:
+  NodeBase* node_;
+};
+
+/// -------------------------------Constructors---------------------------------
+
+template <typename T>
+PersistentList<T>::PersistentList(const std::string& path,
+                                  size_t initial_bytes) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "PersistentList: open " + path);
+  }
+  try {
+    struct stat status;
+    if (::fstat(fd_, &status) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "PersistentList: fstat");
+    }
+    size_t bytes = static_cast<size_t>(status.st_size);
+    if (bytes == 0) {
+      bytes = std::max(initial_bytes, kFirstNode + sizeof(Node));
+      if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "PersistentList: ftruncate");
+      }
+      Map(bytes);
+      Header& meta = Meta();
+      meta.magic = kMagic;
+      meta.node_size = sizeof(Node);
+      meta.size = 0;
+      meta.used = kFirstNode;
+      meta.free_list = 0;
+      meta.sentinel = NodeBase{0, 0};
+      return;
+    }
+    if (bytes < sizeof(Header)) {
+      throw std::runtime_error("PersistentList: not a list file");
+    }
+    Map(bytes);
+    if (Meta().magic != kMagic || Meta().node_size != sizeof(Node)) {
+      throw std::runtime_error(
+          "PersistentList: the file holds a list of another type");
+    }
+  } catch (...) {
+    if (base_ != nullptr) {
+      ::munmap(base_, mapped_bytes_);
+    }
+    ::close(fd_);
+    throw;
+  }
+}
+
+template <typename T>
+PersistentList<T>::~PersistentList() {
+  ::munmap(base_, mapped_bytes_);
+  ::close(fd_);
+}
+
+/// -------------------------------Iterators------------------------------------
+
+template <typename T>
+typename PersistentList<T>::iterator PersistentList<T>::Begin() const {
+  return iterator(Next(Sentinel()));
+}
+
+template <typename T>
+typename PersistentList<T>::const_iterator PersistentList<T>::Cbegin() const {
+  return const_iterator(Next(Sentinel()));
+}
+
+template <typename T>
+typename PersistentList<T>::iterator PersistentList<T>::End() const {
+  return iterator(Sentinel());
+}
+
+template <typename T>
+typename PersistentList<T>::const_iterator PersistentList<T>::Cend() const {
+  return const_iterator(Sentinel());
+}
+
+/// -----------------------Element access methods-------------------------------
+
+template <typename T>
+T& PersistentList<T>::Front() {
+  return Value(Next(Sentinel()));
+}
+
+template <typename T>
+const T& PersistentList<T>::Front() const {
+  return Value(Next(Sentinel()));
+}
+
+template <typename T>
+T& PersistentList<T>::Back() {
+  return Value(Prev(Sentinel()));
+}
+
+template <typename T>
+const T& PersistentList<T>::Back() const {
+  return Value(Prev(Sentinel()));
+}
+
+/// ------------------------------Modifiers-------------------------------------
+
+template <typename T>
+void PersistentList<T>::PushBack(const T& value) {
+  T copy = value;  // value may live in the mapping, which AllocateNode moves
+  Node* node = AllocateNode();
+  std::memcpy(&node->value, &copy, sizeof(T));
+  LinkBefore(Sentinel(), node);
+  ++Meta().size;
+}
+
+template <typename T>
+void PersistentList<T>::PushFront(const T& value) {
+  T copy = value;
+  Node* node = AllocateNode();
+  std::memcpy(&node->value, &copy, sizeof(T));
+  LinkBefore(Next(Sentinel()), node);
+  ++Meta().size;
+}
+
+template <typename T>
+void PersistentList<T>::PopBack() {
+  if (Empty()) {
+    return;
+  }
+  NodeBase* node = Prev(Sentinel());
+  Unlink(node);
+  ReleaseNode(node);
+  --Meta().size;
+}
+
+template <typename T>
+void PersistentList<T>::PopFront() {
+  if (Empty()) {
+    return;
+  }
+  NodeBase* node = Next(Sentinel());
+  Unlink(node);
+  ReleaseNode(node);
+  --Meta().size;
+}
+
+template <typename T>
+void PersistentList<T>::Clear() {
+  NodeBase* sentinel = Sentinel();
+  NodeBase* node = Next(sentinel);
+  while (node != sentinel) {
+    NodeBase* next = Next(node);
+    ReleaseNode(node);
+    node = next;
+  }
+  sentinel->next = 0;
+  sentinel->prev = 0;
+  Meta().size = 0;
+}
+
+template <typename T>
+void PersistentList<T>::Flush() {
+  if (::msync(base_, mapped_bytes_, MS_SYNC) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "PersistentList: msync");
+  }
+}
+
+/// ------------------------------Mapping---------------------------------------
+
+template <typename T>
+void PersistentList<T>::Map(size_t bytes) {
+  void* address =
+      ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (address == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(),
+                            "PersistentList: mmap");
+  }
+  base_ = static_cast<char*>(address);
+  mapped_bytes_ = bytes;
+}
+
+template <typename T>
+void PersistentList<T>::Grow(size_t bytes) {
+  size_t new_bytes = std::max(bytes, 2 * mapped_bytes_);
+  if (::ftruncate(fd_, static_cast<off_t>(new_bytes)) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "PersistentList: ftruncate");
+  }
+  char* old_base = base_;
+  size_t old_bytes = mapped_bytes_;
+  Map(new_bytes);
+  ::munmap(old_base, old_bytes);
+}
+
+template <typename T>
+typename PersistentList<T>::Node* PersistentList<T>::AllocateNode() {
+  Header& meta = Meta();
+  if (meta.free_list != 0) {
+    Node* node = reinterpret_cast<Node*>(base_ + meta.free_list);
+    meta.free_list = static_cast<uint64_t>(node->next);
+    return node;
+  }
+  size_t offset = meta.used;
+  if (offset + sizeof(Node) > mapped_bytes_) {
+    Grow(offset + sizeof(Node));
+  }
+  Meta().used = offset + sizeof(Node);
+  return reinterpret_cast<Node*>(base_ + offset);
+}
+
+template <typename T>
+void PersistentList<T>::ReleaseNode(NodeBase* node) {
+  Header& meta = Meta();
+  node->next = static_cast<std::ptrdiff_t>(meta.free_list);
+  meta.free_list = static_cast<uint64_t>(reinterpret_cast<char*>(node) - base_);
+}
+
+template <typename T>
+void PersistentList<T>::LinkBefore(NodeBase* position, NodeBase* node) {
+  NodeBase* before = Prev(position);
+  node->prev = Offset(node, before);
+  node->next = Offset(node, position);
+  before->next = Offset(before, node);
+  position->prev = Offset(position, node);
+}
+
+template <typename T>
+void PersistentList<T>::Unlink(NodeBase* node) {
+  NodeBase* before = Prev(node);
+  NodeBase* after = Next(node);
+  before->next = Offset(before, after);
+  after->prev = Offset(after, before);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// SortedList: a List kept in Compare order with skip-list express lanes on
+/// top. Level 0 is the List itself, so iteration is the usual walk over its
+/// nodes (AsList() gives the List). About every fourth node also has an
+/// express entry on level 1, every sixteenth on level 2 and so on; entries
+/// are allocated with the list's allocator and point down to the level
+/// below and, on level 1, to the List node. Insert, Find, LowerBound and
+/// Erase take expected O(log n). Equivalent elements are kept in insertion
+/// order. Elements are only exposed as const, since changing them could
+/// break the order.
+
+template <typename T, typename Compare = std::less<T>,
+          typename Allocator = std::allocator<T>>
+class SortedList {
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using list_type = List<T, Allocator>;
+  using iterator = typename list_type::const_iterator;
+  using const_iterator = typename list_type::const_iterator;
+
+  static constexpr size_t kMaxLevel = 32;
+
+  explicit SortedList(Compare comp = Compare(),
+                      const Allocator& alloc = Allocator());
+
+  SortedList(const SortedList&) = delete;
+  SortedList& operator=(const SortedList&) = delete;
+
+  SortedList(SortedList&& other) noexcept;
+
+  ~SortedList();
+
+  [[nodiscard]] size_t Size() const { return list_.Size(); }
+
+  [[nodiscard]] bool Empty() const { return list_.Empty(); }
+
+  [[nodiscard]] const list_type& AsList() const { return list_; }
+
+  [[nodiscard]] const_iterator Begin() const { return list_.Cbegin(); }
+  [[nodiscard]] const_iterator Cbegin() const { return list_.Cbegin(); }
+  [[nodiscard]] const_iterator End() const { return list_.Cend(); }
+  [[nodiscard]] const_iterator Cend() const { return list_.Cend(); }
+
+  [[nodiscard]] const T& Front() const { return list_.Front(); }
+  [[nodiscard]] const T& Back() const { return list_.Back(); }
+
+  // Inserts after the elements equivalent to value.
+  template <typename U>
+  iterator Insert(U&& value);
+
+  // The first element not less than value.
+  [[nodiscard]] iterator LowerBound(const T& value) const;
+
+  // The first element equivalent to value, or End().
+  [[nodiscard]] iterator Find(const T& value) const;
+
+  iterator Erase(const_iterator pos);
+
+  // Erases all elements equivalent to value, returns their number.
+  size_t Erase(const T& value);
+
+  void Clear();
+
+  private:
+  struct Express {
+    Express* next;
+    // The entry below, nullptr on level 1.
+    Express* down;
+    // The List node; unused in heads.
+    const_iterator it;
+  };
+
+  using express_alloc_traits = typename std::allocator_traits<
+      Allocator>::template rebind_traits<Express>;
+  using express_alloc_type = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<Express>;
+
+  list_type list_;
+  // heads_[l] starts level l + 1 and stands for the List sentinel.
+  std::vector<Express*> heads_;
+  Compare comp_;
+  express_alloc_type express_alloc_;
+  uint64_t random_state_ = 0x9e3779b97f4a7c15ULL;
+
+  static const T& Value(const const_iterator& it) { return *it.operator->(); }
+
+  static bool Same(const_iterator left, const_iterator right) {
+    return left == right;
+  }
+
+  bool IsHead(const Express* entry) const { return entry == heads_[0]; }
+
+  // Number of express levels for a new node: 0 with probability 3/4, and
+  // each further level with probability 1/4.
+  size_t RandomLevel();
+
+  // Fills path[l] with the last entry on level l + 1 before value (before
+  // the first equivalent element if or_equal) and returns the last level 0
+  // node before it (End() for the head).
+  const_iterator Descend(const T& value, bool or_equal,
+                         Express** path) const;
+
+  Express* MakeExpress(Express* next, Express* down, const_iterator it);
+
+  void FreeLevels();
+};
+
+/// -------------------------------Constructors---------------------------------
+
+template <typename T, typename Compare, typename Allocator>
+SortedList<T, Compare, Allocator>::SortedList(Compare comp,
+                                              const Allocator& alloc)
+    : list_(alloc), comp_(comp), express_alloc_(alloc) {}
+
+template <typename T, typename Compare, typename Allocator>
+SortedList<T, Compare, Allocator>::SortedList(SortedList&& other) noexcept
+    : list_(std::move(other.list_)),
+      heads_(std::move(other.heads_)),
+      comp_(std::move(other.comp_)),
+      express_alloc_(other.express_alloc_),
+      random_state_(other.random_state_) {
+  other.heads_.clear();
+}
+
+template <typename T, typename Compare, typename Allocator>
+SortedList<T, Compare, Allocator>::~SortedList() {
+  FreeLevels();
+}
+
+/// ------------------------------Modifiers-------------------------------------
+
+template <typename T, typename Compare, typename Allocator>
+template <typename U>
+typename SortedList<T, Compare, Allocator>::iterator
+SortedList<T, Compare, Allocator>::Insert(U&& value) {
+  size_t level = RandomLevel();
+  // Reserved first, so that push_back can not throw with a head in hand.
+  heads_.reserve(level);
+  while (heads_.size() < level) {
+    Express* down = heads_.empty() ? nullptr : heads_.back();
+    heads_.push_back(MakeExpress(nullptr, down, list_.Cend()));
+  }
+  Express* path[kMaxLevel];
+  const_iterator before = Descend(value, false, path);
+  const_iterator it = list_.Emplace(std::next(before), std::forward<U>(value));
+  Express* down = nullptr;
+  for (size_t l = 0; l < level; ++l) {
+    try {
+      path[l]->next = MakeExpress(path[l]->next, down, it);
+    } catch (...) {
+      // Lower levels are complete, the node just stays shorter.
+      break;
+    }
+    down = path[l]->next;
+  }
+  return it;
+}
+
+template <typename T, typename Compare, typename Allocator>
+typename SortedList<T, Compare, Allocator>::iterator
+SortedList<T, Compare, Allocator>::Erase(const_iterator pos) {
+  if (!heads_.empty()) {
+    const T& value = Value(pos);
+    Express* path[kMaxLevel];
+    Descend(value, true, path);
+    for (size_t l = 0; l < heads_.size(); ++l) {
+      Express* entry = path[l];
+      while (entry->next != nullptr && !comp_(value, Value(entry->next->it)) &&
+             !Same(entry->next->it, pos)) {
+        entry = entry->next;
+      }
+      Express* victim = entry->next;
+      if (victim == nullptr || !Same(victim->it, pos)) {
+        break;  // the node has no entries this high
+      }
+      entry->next = victim->next;
+      express_alloc_traits::destroy(express_alloc_, victim);
+      express_alloc_traits::deallocate(express_alloc_, victim, 1);
+    }
+  }
+  return list_.Erase(pos);
+}
+
+template <typename T, typename Compare, typename Allocator>
+size_t SortedList<T, Compare, Allocator>::Erase(const T& value) {
+  size_t erased = 0;
+  for (const_iterator it = Find(value); !Same(it, list_.Cend()) &&
+                                        !comp_(value, Value(it));
+       ++erased) {
+    it = Erase(it);
+  }
+  return erased;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void SortedList<T, Compare, Allocator>::Clear() {
+  FreeLevels();
+  while (!list_.Empty()) {
+    list_.PopBack();
+  }
+}
+
+/// ------------------------------Lookup----------------------------------------
+
+template <typename T, typename Compare, typename Allocator>
+typename SortedList<T, Compare, Allocator>::iterator
+SortedList<T, Compare, Allocator>::LowerBound(const T& value) const {
+  Express* path[kMaxLevel];
+  return std::next(Descend(value, true, path));
+}
+
+template <typename T, typename Compare, typename Allocator>
+typename SortedList<T, Compare, Allocator>::iterator
+SortedList<T, Compare, Allocator>::Find(const T& value) const {
+  const_iterator it = LowerBound(value);
+  if (!Same(it, list_.Cend()) && comp_(value, Value(it))) {
+    return list_.Cend();
+  }
+  return it;
+}
+
+/// ------------------------------Express lanes---------------------------------
+
+template <typename T, typename Compare, typename Allocator>
+size_t SortedList<T, Compare, Allocator>::RandomLevel() {
+  // xorshift64*
+  random_state_ ^= random_state_ >> 12;
+  random_state_ ^= random_state_ << 25;
+  random_state_ ^= random_state_ >> 27;
+  uint64_t bits = random_state_ * 0x2545f4914f6cdd1dULL;
+  size_t level = 0;
+  while ((bits & 3) == 0 && level < kMaxLevel) {
+    ++level;
+    bits >>= 2;
+  }
+  return level;
+}
+
+template <typename T, typename Compare, typename Allocator>
+typename SortedList<T, Compare, Allocator>::const_iterator
+SortedList<T, Compare, Allocator>::Descend(const T& value, bool or_equal,
+                                           Express** path) const {
+  // Moves right while the next element is before value (or, for Insert,
+  // not after it).
+  auto before = [this, &value, or_equal](const const_iterator& it) {
+    return or_equal ? comp_(Value(it), value) : !comp_(value, Value(it));
+  };
+  const_iterator it = list_.Cend();
+  if (!heads_.empty()) {
+    Express* entry = heads_.back();
+    for (size_t l = heads_.size(); l > 0; --l) {
+      while (entry->next != nullptr && before(entry->next->it)) {
+        entry = entry->next;
+      }
+      path[l - 1] = entry;
+      if (l > 1) {
+        entry = entry->down;
+      }
+    }
+    if (!IsHead(entry)) {
+      it = entry->it;
+    }
+  }
+  for (const_iterator next = std::next(it);
+       !Same(next, list_.Cend()) && before(next); ++next) {
+    it = next;
+  }
+  return it;
+}
+
+template <typename T, typename Compare, typename Allocator>
+typename SortedList<T, Compare, Allocator>::Express*
+SortedList<T, Compare, Allocator>::MakeExpress(Express* next, Express* down,
+                                               const_iterator it) {
+  Express* entry = express_alloc_traits::allocate(express_alloc_, 1);
+  express_alloc_traits::construct(express_alloc_, entry,
+                                  Express{next, down, it});
+  return entry;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void SortedList<T, Compare, Allocator>::FreeLevels() {
+  for (Express* head : heads_) {
+    while (head != nullptr) {
+      Express* next = head->next;
+      express_alloc_traits::destroy(express_alloc_, head);
+      express_alloc_traits::deallocate(express_alloc_, head, 1);
+      head = next;
+    }
+  }
+  heads_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// LruCache: a List of entries from the most to the least recently used and
+/// a hash index of its nodes. A hit splices the node to the front, and a
+/// Put into a full cache overwrites the least recently used entry in its
+/// node and splices it to the front, so neither touches the allocator. The
+/// list and the index use the rebound Allocator.
+
+struct LruCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+};
+
+template <typename K, typename V,
+          typename Allocator = std::allocator<std::pair<K, V>>,
+          typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class LruCache {
+  public:
+  using entry_type = std::pair<K, V>;
+  using list_type = List<entry_type, typename std::allocator_traits<
+                                         Allocator>::template rebind_alloc<
+                                         entry_type>>;
+
+  explicit LruCache(size_t capacity, const Allocator& alloc = Allocator());
+
+  // The index refers to the nodes of entries_, so a copy could not share it;
+  // moving keeps the nodes where they are.
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+  LruCache(LruCache&&) = default;
+  LruCache& operator=(LruCache&&) = default;
+
+  [[nodiscard]] size_t Size() const { return entries_.Size(); }
+  [[nodiscard]] bool Empty() const { return entries_.Empty(); }
+  [[nodiscard]] size_t Capacity() const { return capacity_; }
+
+  // Entries from the most to the least recently used. Read only: the index
+  // is keyed by the entries' keys.
+  using const_iterator = typename list_type::const_iterator;
+  [[nodiscard]] const_iterator Cbegin() const { return entries_.Cbegin(); }
+  [[nodiscard]] const_iterator Cend() const { return entries_.Cend(); }
+  [[nodiscard]] const_iterator begin() const { return Cbegin(); }
+  [[nodiscard]] const_iterator end() const { return Cend(); }
+
+  // The value for key, which becomes the most recently used, or nullptr.
+  V* Get(const K& key);
+
+  // Does not count as a use.
+  [[nodiscard]] bool Contains(const K& key) const;
+
+  // Inserts or overwrites the value for key and makes it the most recently
+  // used, evicting the least recently used entry if the cache is full. If
+  // assigning to the evicted entry throws, the entry is dropped.
+  template <typename U>
+  void Put(const K& key, U&& value);
+
+  bool Erase(const K& key);
+
+  void Clear();
+
+  [[nodiscard]] LruCacheStats Stats() const { return stats_; }
+  void ResetStats() { stats_ = LruCacheStats(); }
+
+  private:
+  using list_iterator = typename list_type::iterator;
+  using index_type = std::unordered_map<
+      K, list_iterator, Hash, KeyEqual,
+      typename std::allocator_traits<Allocator>::template rebind_alloc<
+          std::pair<const K, list_iterator>>>;
+
+  size_t capacity_;
+  list_type entries_;
+  index_type index_;
+  LruCacheStats stats_;
+
+  void MoveToFront(list_iterator it) {
+    entries_.Splice(entries_.Cbegin(), entries_, it);
+  }
+};
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+LruCache<K, V, Allocator, Hash, KeyEqual>::LruCache(size_t capacity,
+                                                   const Allocator& alloc)
+    : capacity_(capacity),
+      entries_(typename list_type::allocator_type(alloc)),
+      index_(0, Hash(), KeyEqual(),
+             typename index_type::allocator_type(alloc)) {
+  index_.reserve(capacity);
+}
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+V* LruCache<K, V, Allocator, Hash, KeyEqual>::Get(const K& key) {
+  auto found = index_.find(key);
+  if (found == index_.end()) {
+    ++stats_.misses;
+    return nullptr;
+  }
+  ++stats_.hits;
+  MoveToFront(found->second);
+  return &found->second->second;
+}
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool LruCache<K, V, Allocator, Hash, KeyEqual>::Contains(const K& key) const {
+  return index_.find(key) != index_.end();
+}
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename U>
+void LruCache<K, V, Allocator, Hash, KeyEqual>::Put(const K& key, U&& value) {
+  if (capacity_ == 0) {
+    return;
+  }
+  // One lookup both finds an existing entry and reserves the slot for a new
+  // one, so a miss followed by a Put hashes the key twice, not three times.
+  auto [slot, inserted] = index_.try_emplace(key, entries_.End());
+  if (!inserted) {
+    slot->second->second = std::forward<U>(value);
+    MoveToFront(slot->second);
+    return;
+  }
+  if (entries_.Size() < capacity_) {
+    try {
+      entries_.EmplaceFront(key, std::forward<U>(value));
+    } catch (...) {
+      index_.erase(slot);
+      throw;
+    }
+    slot->second = entries_.Begin();
+    return;
+  }
+  list_iterator victim = entries_.End();
+  --victim;
+  index_.erase(victim->first);
+  ++stats_.evictions;
+  try {
+    victim->first = key;
+    victim->second = std::forward<U>(value);
+  } catch (...) {
+    index_.erase(slot);
+    entries_.PopBack();
+    throw;
+  }
+  slot->second = victim;
+  MoveToFront(victim);
+}
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool LruCache<K, V, Allocator, Hash, KeyEqual>::Erase(const K& key) {
+  auto found = index_.find(key);
+  if (found == index_.end()) {
+    return false;
+  }
+  entries_.Erase(found->second);
+  index_.erase(found);
+  return true;
+}
+
+template <typename K, typename V, typename Allocator, typename Hash,
+          typename KeyEqual>
+void LruCache<K, V, Allocator, Hash, KeyEqual>::Clear() {
+  index_.clear();
+  while (!entries_.Empty()) {
+    entries_.PopBack();
+  }
+}
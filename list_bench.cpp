@@ -0,0 +1,1084 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "list.hpp"
+
+namespace {
+
+size_t bytes_in_use = 0;
+
+template <typename T>
+struct ByteCountingAllocator {
+  using value_type = T;
+
+  ByteCountingAllocator() = default;
+  template <typename U>
+  ByteCountingAllocator(const ByteCountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    bytes_in_use += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    bytes_in_use -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const ByteCountingAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const ByteCountingAllocator<U>&) const {
+    return false;
+  }
+};
+
+template <typename Container>
+void BenchTraversal(const char* name, size_t size, size_t rounds) {
+  size_t before = bytes_in_use;
+  Container container;
+  for (size_t i = 0; i < size; ++i) {
+    container.PushBack(static_cast<int>(i));
+  }
+  double bytes_per_element =
+      static_cast<double>(bytes_in_use - before) / static_cast<double>(size);
+
+  long long sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    for (auto it = container.Begin(); it != container.End(); ++it) {
+      sum += *it;
+    }
+  }
+  auto finish = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(finish - start).count();
+  std::printf("%-14s size=%-9zu %8.3f ns/elem %8.2f bytes/elem (checksum %lld)\n",
+              name, size, ns / static_cast<double>(size * rounds),
+              bytes_per_element, sum);
+}
+
+// Nodes are allocated in a random order and then sorted, so consecutive
+// elements live far apart in memory and every step of a traversal is a
+// cache miss.
+List<long long> ScatteredList(size_t size) {
+  std::vector<long long> values(size);
+  std::iota(values.begin(), values.end(), 0);
+  std::shuffle(values.begin(), values.end(), std::mt19937_64(42));
+  List<long long> list;
+  for (long long value : values) {
+    list.PushBack(value);
+  }
+  list.Sort();
+  return list;
+}
+
+template <typename Sum>
+void BenchScatteredSum(const char* name, const List<long long>& list,
+                       size_t rounds, Sum sum) {
+  long long total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    total += sum(list);
+  }
+  auto finish = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(finish - start).count();
+  std::printf("%-22s %8.3f ns/elem (checksum %lld)\n", name,
+              ns / static_cast<double>(list.Size() * rounds), total);
+}
+
+void BenchPrefetch(size_t size, size_t rounds) {
+  List<long long> list = ScatteredList(size);
+  BenchScatteredSum("range-for", list, rounds, [](const List<long long>& l) {
+    long long sum = 0;
+    for (auto it = l.Cbegin(); it != l.Cend(); ++it) {
+      sum += *it;
+    }
+    return sum;
+  });
+  for (size_t distance : {0, 2, 4, 8, 16, 32}) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "Accumulate d=%zu", distance);
+    BenchScatteredSum(name, list, rounds,
+                      [distance](const List<long long>& l) {
+                        return l.Accumulate(0LL, std::plus<>(), distance);
+                      });
+  }
+  BenchScatteredSum("range-for count", list, rounds,
+                    [](const List<long long>& l) {
+                      long long count = 0;
+                      for (auto it = l.Cbegin(); it != l.Cend(); ++it) {
+                        count += *it % 3 == 0 ? 1 : 0;
+                      }
+                      return count;
+                    });
+  BenchScatteredSum("CountIf", list, rounds, [](const List<long long>& l) {
+    return static_cast<long long>(
+        l.CountIf([](long long value) { return value % 3 == 0; }));
+  });
+  // A little work per element gives the prefetches time to complete.
+  auto heavy = [](long long value) {
+    for (int i = 0; i < 16; ++i) {
+      value = value * 6364136223846793005LL + 1442695040888963407LL;
+    }
+    return value;
+  };
+  BenchScatteredSum("range-for + work", list, rounds,
+                    [&heavy](const List<long long>& l) {
+                      long long sum = 0;
+                      for (auto it = l.Cbegin(); it != l.Cend(); ++it) {
+                        sum += heavy(*it);
+                      }
+                      return sum;
+                    });
+  BenchScatteredSum("ForEach + work d=16", list, rounds,
+                    [&heavy](const List<long long>& l) {
+                      long long sum = 0;
+                      l.ForEach([&](long long value) { sum += heavy(value); },
+                                16);
+                      return sum;
+                    });
+}
+
+template <typename Produce, typename Consume>
+void BenchHandoff(const char* name, int producers, int per_producer,
+                  Produce produce, Consume consume) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&produce, per_producer] {
+      for (int i = 0; i < per_producer; ++i) {
+        produce(i);
+      }
+    });
+  }
+  long long total = static_cast<long long>(producers) * per_producer;
+  long long received = 0;
+  while (received < total) {
+    received += consume();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(finish - start).count();
+  std::printf("%-14s producers=%-3d %10.0f items/s\n", name, producers,
+              static_cast<double>(total) / seconds);
+}
+
+void BenchQueues(int producers, int per_producer) {
+  MpscQueue<int> queue;
+  List<int> drained;
+  BenchHandoff(
+      "MpscQueue", producers, per_producer,
+      [&queue](int value) { queue.PushBack(value); },
+      [&queue, &drained] {
+        size_t count = queue.DrainTo(drained);
+        while (!drained.Empty()) {
+          drained.PopFront();
+        }
+        return static_cast<long long>(count);
+      });
+
+  std::mutex mutex;
+  List<int> list;
+  BenchHandoff(
+      "mutex + List", producers, per_producer,
+      [&mutex, &list](int value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        list.PushBack(value);
+      },
+      [&mutex, &list] {
+        std::lock_guard<std::mutex> lock(mutex);
+        long long count = static_cast<long long>(list.Size());
+        while (!list.Empty()) {
+          list.PopFront();
+        }
+        return count;
+      });
+}
+
+// Every thread inserts and erases keys in its own region of a sorted list.
+template <typename Insert, typename Erase>
+void BenchMidList(const char* name, int threads, int ops_per_thread,
+                  int region, Insert insert, Erase erase) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&insert, &erase, t, ops_per_thread, region] {
+      for (int i = 0; i < ops_per_thread; ++i) {
+        int key = t * region + 1 + (i % (region - 1));
+        insert(key);
+        erase(key);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(finish - start).count();
+  std::printf("%-22s threads=%-3d %10.0f ops/s\n", name, threads,
+              2.0 * threads * ops_per_thread / seconds);
+}
+
+void BenchConcurrentLists(int threads) {
+  constexpr int kRegion = 64;
+  constexpr int kOps = 20'000;
+  ConcurrentList<int> concurrent;
+  std::mutex mutex;
+  std::list<int> locked;
+  for (int t = 0; t <= threads; ++t) {
+    concurrent.EmplaceBack(t * kRegion);
+    locked.push_back(t * kRegion);
+  }
+  BenchMidList(
+      "ConcurrentList", threads, kOps, kRegion,
+      [&concurrent](int key) {
+        concurrent.EmplaceBefore([key](int value) { return value > key; },
+                                 key);
+      },
+      [&concurrent](int key) { concurrent.Erase(key); });
+  BenchMidList(
+      "mutex + std::list", threads, kOps, kRegion,
+      [&mutex, &locked](int key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = locked.begin();
+        while (it != locked.end() && *it <= key) {
+          ++it;
+        }
+        locked.insert(it, key);
+      },
+      [&mutex, &locked](int key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = locked.begin(); it != locked.end(); ++it) {
+          if (*it == key) {
+            locked.erase(it);
+            break;
+          }
+        }
+      });
+}
+
+
+/// ------------------------------Suite------------------------------------------
+// list_bench --suite: List against std::list, std::deque and std::vector for
+// every operation, element size and length; one record per combination in
+// CSV or JSON. Each measurement runs on a batch of containers with about
+// kBatchElements elements in total and is repeated reps times; the median
+// and the minimum are reported in nanoseconds per element.
+
+constexpr size_t kBatchElements = 1 << 18;
+
+template <size_t kBytes>
+struct Payload {
+  Payload() = default;
+  explicit Payload(size_t seed) { bytes[0] = static_cast<unsigned char>(seed); }
+
+  unsigned char bytes[kBytes] = {};
+};
+
+// Uniform access to the four containers; kFrontOps is false where the
+// container has no O(1) push/pop at the front.
+template <typename Container>
+struct Adapter;
+
+template <typename T>
+struct Adapter<List<T>> {
+  static constexpr const char* kName = "List";
+  static constexpr bool kFrontOps = true;
+  static void PushBack(List<T>& c, const T& value) { c.PushBack(value); }
+  static void PushFront(List<T>& c, const T& value) { c.PushFront(value); }
+  static void PopBack(List<T>& c) { c.PopBack(); }
+  static void PopFront(List<T>& c) { c.PopFront(); }
+  static size_t Sum(const List<T>& c) {
+    size_t sum = 0;
+    for (auto it = c.Cbegin(); it != c.Cend(); ++it) {
+      sum += it->bytes[0];
+    }
+    return sum;
+  }
+};
+
+template <typename Container>
+struct StdAdapter {
+  using T = typename Container::value_type;
+  static void PushBack(Container& c, const T& value) { c.push_back(value); }
+  static void PushFront(Container& c, const T& value) { c.push_front(value); }
+  static void PopBack(Container& c) { c.pop_back(); }
+  static void PopFront(Container& c) { c.pop_front(); }
+  static size_t Sum(const Container& c) {
+    size_t sum = 0;
+    for (const T& value : c) {
+      sum += value.bytes[0];
+    }
+    return sum;
+  }
+};
+
+template <typename T>
+struct Adapter<std::list<T>> : StdAdapter<std::list<T>> {
+  static constexpr const char* kName = "std::list";
+  static constexpr bool kFrontOps = true;
+};
+
+template <typename T>
+struct Adapter<std::deque<T>> : StdAdapter<std::deque<T>> {
+  static constexpr const char* kName = "std::deque";
+  static constexpr bool kFrontOps = true;
+};
+
+template <typename T>
+struct Adapter<std::vector<T>> : StdAdapter<std::vector<T>> {
+  static constexpr const char* kName = "std::vector";
+  static constexpr bool kFrontOps = false;
+  static void PushFront(std::vector<T>&, const T&) {}
+  static void PopFront(std::vector<T>&) {}
+};
+
+struct SuiteOptions {
+  bool json = false;
+  size_t max_length = 1'000'000;
+  size_t max_bytes = size_t{1} << 30;
+  size_t reps = 5;
+};
+
+struct SuiteRecord {
+  const char* container;
+  const char* operation;
+  size_t element_bytes;
+  size_t length;
+  size_t batch;
+  size_t reps;
+  double median_ns;
+  double min_ns;
+};
+
+volatile size_t sink = 0;
+
+template <typename Container>
+void Fill(Container& c, size_t length) {
+  using T = typename Container::value_type;
+  for (size_t i = 0; i < length; ++i) {
+    Adapter<Container>::PushBack(c, T(i));
+  }
+}
+
+template <typename Container>
+std::vector<Container> FilledBatch(size_t batch, size_t length) {
+  std::vector<Container> containers(batch);
+  for (auto& c : containers) {
+    Fill(c, length);
+  }
+  return containers;
+}
+
+// setup() prepares the state outside of the timed region, body(state) is
+// timed, and the state is destroyed afterwards, again untimed.
+template <typename Setup, typename Body>
+void Measure(SuiteRecord& record, Setup setup, Body body) {
+  std::vector<double> samples;
+  double elements = static_cast<double>(record.batch * record.length);
+  for (size_t rep = 0; rep < record.reps; ++rep) {
+    auto state = setup();
+    auto start = std::chrono::steady_clock::now();
+    body(state);
+    auto finish = std::chrono::steady_clock::now();
+    samples.push_back(
+        std::chrono::duration<double, std::nano>(finish - start).count() /
+        elements);
+  }
+  std::sort(samples.begin(), samples.end());
+  record.median_ns = samples[samples.size() / 2];
+  record.min_ns = samples.front();
+}
+
+template <typename Container>
+void RunContainer(const SuiteOptions& options, size_t length,
+                  std::vector<SuiteRecord>& records) {
+  using T = typename Container::value_type;
+  using A = Adapter<Container>;
+  const size_t batch = std::max<size_t>(1, kBatchElements / length);
+  // Two live copies of every element plus per-element node overhead.
+  const size_t footprint = 2 * batch * length * (sizeof(T) + 32);
+  if (footprint > options.max_bytes) {
+    return;
+  }
+  auto record = [&](const char* operation) {
+    return SuiteRecord{A::kName, operation, sizeof(T), length,
+                       batch,    options.reps, 0,       0};
+  };
+  auto empty_batch = [batch] { return std::vector<Container>(batch); };
+  auto filled_batch = [batch, length] {
+    return FilledBatch<Container>(batch, length);
+  };
+  auto reserved_batch = [batch] {
+    std::vector<Container> containers;
+    containers.reserve(batch);
+    return containers;
+  };
+
+  SuiteRecord push_back = record("push_back");
+  Measure(push_back, empty_batch, [length](std::vector<Container>& cs) {
+    for (auto& c : cs) {
+      Fill(c, length);
+    }
+  });
+  records.push_back(push_back);
+
+  SuiteRecord pop_back = record("pop_back");
+  Measure(pop_back, filled_batch, [length](std::vector<Container>& cs) {
+    for (auto& c : cs) {
+      for (size_t i = 0; i < length; ++i) {
+        A::PopBack(c);
+      }
+    }
+  });
+  records.push_back(pop_back);
+
+  if (A::kFrontOps) {
+    SuiteRecord push_front = record("push_front");
+    Measure(push_front, empty_batch, [length](std::vector<Container>& cs) {
+      for (auto& c : cs) {
+        for (size_t i = 0; i < length; ++i) {
+          A::PushFront(c, T(i));
+        }
+      }
+    });
+    records.push_back(push_front);
+
+    SuiteRecord pop_front = record("pop_front");
+    Measure(pop_front, filled_batch, [length](std::vector<Container>& cs) {
+      for (auto& c : cs) {
+        for (size_t i = 0; i < length; ++i) {
+          A::PopFront(c);
+        }
+      }
+    });
+    records.push_back(pop_front);
+  }
+
+  SuiteRecord fill_ctor = record("fill_ctor");
+  Measure(fill_ctor, reserved_batch,
+          [batch, length](std::vector<Container>& cs) {
+            for (size_t b = 0; b < batch; ++b) {
+              cs.emplace_back(length, T(b));
+            }
+          });
+  records.push_back(fill_ctor);
+
+  Container source;
+  Fill(source, length);
+
+  SuiteRecord copy_ctor = record("copy_ctor");
+  Measure(copy_ctor, reserved_batch,
+          [batch, &source](std::vector<Container>& cs) {
+            for (size_t b = 0; b < batch; ++b) {
+              cs.emplace_back(source);
+            }
+          });
+  records.push_back(copy_ctor);
+
+  SuiteRecord traversal = record("traversal");
+  Measure(traversal, filled_batch, [](std::vector<Container>& cs) {
+    size_t sum = 0;
+    for (const auto& c : cs) {
+      sum += A::Sum(c);
+    }
+    sink = sink + sum;
+  });
+  records.push_back(traversal);
+
+  SuiteRecord copy_assign = record("copy_assign");
+  Measure(copy_assign, filled_batch, [&source](std::vector<Container>& cs) {
+    for (auto& c : cs) {
+      c = source;
+    }
+  });
+  records.push_back(copy_assign);
+
+  // Moves a filled batch onto another filled batch, so the time includes
+  // releasing the elements the targets held before.
+  SuiteRecord move_assign = record("move_assign");
+  Measure(
+      move_assign,
+      [&filled_batch] {
+        return std::make_pair(filled_batch(), filled_batch());
+      },
+      [batch](std::pair<std::vector<Container>, std::vector<Container>>& cs) {
+        for (size_t b = 0; b < batch; ++b) {
+          cs.first[b] = std::move(cs.second[b]);
+        }
+      });
+  records.push_back(move_assign);
+
+  SuiteRecord destroy = record("destroy");
+  Measure(destroy, filled_batch,
+          [](std::vector<Container>& cs) { cs.clear(); });
+  records.push_back(destroy);
+}
+
+template <size_t kBytes>
+void RunElementSize(const SuiteOptions& options,
+                    std::vector<SuiteRecord>& records) {
+  using T = Payload<kBytes>;
+  for (size_t length = 10; length <= options.max_length; length *= 10) {
+    RunContainer<List<T>>(options, length, records);
+    RunContainer<std::list<T>>(options, length, records);
+    RunContainer<std::deque<T>>(options, length, records);
+    RunContainer<std::vector<T>>(options, length, records);
+  }
+}
+
+void PrintRecords(const SuiteOptions& options,
+                  const std::vector<SuiteRecord>& records) {
+  if (!options.json) {
+    std::printf(
+        "container,operation,element_bytes,length,batch,reps,"
+        "median_ns_per_element,min_ns_per_element\n");
+    for (const auto& r : records) {
+      std::printf("%s,%s,%zu,%zu,%zu,%zu,%.4f,%.4f\n", r.container,
+                  r.operation, r.element_bytes, r.length, r.batch, r.reps,
+                  r.median_ns, r.min_ns);
+    }
+    return;
+  }
+  std::printf("{\n  \"compiler\": \"%s\",\n  \"results\": [\n", __VERSION__);
+  for (size_t i = 0; i < records.size(); ++i) {
+    const auto& r = records[i];
+    std::printf(
+        "    {\"container\": \"%s\", \"operation\": \"%s\", "
+        "\"element_bytes\": %zu, \"length\": %zu, \"batch\": %zu, "
+        "\"reps\": %zu, \"median_ns_per_element\": %.4f, "
+        "\"min_ns_per_element\": %.4f}%s\n",
+        r.container, r.operation, r.element_bytes, r.length, r.batch, r.reps,
+        r.median_ns, r.min_ns, i + 1 < records.size() ? "," : "");
+  }
+  std::printf("  ]\n}\n");
+}
+
+bool ParseSuiteOptions(int argc, char** argv, SuiteOptions& options) {
+  for (int i = 2; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (std::strcmp(arg, "--format=json") == 0) {
+      options.json = true;
+    } else if (std::strcmp(arg, "--format=csv") == 0) {
+      options.json = false;
+    } else if (std::strncmp(arg, "--max-length=", 13) == 0) {
+      options.max_length = std::strtoull(arg + 13, nullptr, 10);
+    } else if (std::strncmp(arg, "--max-bytes=", 12) == 0) {
+      options.max_bytes = std::strtoull(arg + 12, nullptr, 10);
+    } else if (std::strncmp(arg, "--reps=", 7) == 0) {
+      options.reps = std::max<size_t>(1, std::strtoull(arg + 7, nullptr, 10));
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s --suite [--format=csv|json] [--max-length=N] "
+                   "[--max-bytes=N] [--reps=N]\n",
+                   argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+int RunSuite(int argc, char** argv) {
+  SuiteOptions options;
+  if (!ParseSuiteOptions(argc, argv, options)) {
+    return 1;
+  }
+  std::vector<SuiteRecord> records;
+  RunElementSize<4>(options, records);
+  RunElementSize<16>(options, records);
+  RunElementSize<64>(options, records);
+  RunElementSize<256>(options, records);
+  PrintRecords(options, records);
+  return 0;
+}
+
+void BenchCompact(size_t size, size_t rounds) {
+  List<long long> list = ScatteredList(size);
+  auto sum = [](const List<long long>& l) {
+    long long total = 0;
+    for (auto it = l.Cbegin(); it != l.Cend(); ++it) {
+      total += *it;
+    }
+    return total;
+  };
+  BenchScatteredSum("scattered", list, rounds, sum);
+  auto start = std::chrono::steady_clock::now();
+  list.Compact();
+  auto finish = std::chrono::steady_clock::now();
+  std::printf("%-22s %8.1f ms\n", "Compact",
+              std::chrono::duration<double, std::milli>(finish - start)
+                  .count());
+  BenchScatteredSum("compacted", list, rounds, sum);
+
+  List<long long> stepped = ScatteredList(size);
+  size_t steps = 1;
+  start = std::chrono::steady_clock::now();
+  while (!stepped.CompactStep(4096)) {
+    ++steps;
+  }
+  finish = std::chrono::steady_clock::now();
+  std::printf("%-22s %8.1f ms in %zu steps\n", "CompactStep(4096)",
+              std::chrono::duration<double, std::milli>(finish - start)
+                  .count(),
+              steps);
+  BenchScatteredSum("step-compacted", stepped, rounds, sum);
+}
+
+template <typename Container, typename Build>
+void BenchTeardownOne(const char* name, size_t size, Build build) {
+  auto container = std::make_unique<Container>(build(size));
+  auto start = std::chrono::steady_clock::now();
+  container.reset();
+  auto finish = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(finish - start).count();
+  std::printf("%-22s size=%-9zu %10.3f ms %8.3f ns/elem\n", name, size,
+              ns / 1e6, ns / static_cast<double>(size));
+}
+
+void BenchTeardown() {
+  for (size_t size : {10'000, 100'000, 1'000'000, 10'000'000}) {
+    BenchTeardownOne<List<int>>("List pushed", size, [](size_t n) {
+      List<int> list;
+      for (size_t i = 0; i < n; ++i) {
+        list.PushBack(static_cast<int>(i));
+      }
+      return list;
+    });
+    BenchTeardownOne<List<int>>("List filled", size, [](size_t n) {
+      return List<int>(n, 1);
+    });
+    BenchTeardownOne<List<int>>("List compacted", size, [](size_t n) {
+      List<int> list;
+      for (size_t i = 0; i < n; ++i) {
+        list.PushBack(static_cast<int>(i));
+      }
+      list.Compact();
+      return list;
+    });
+    BenchTeardownOne<std::list<int>>("std::list", size, [](size_t n) {
+      return std::list<int>(n, 1);
+    });
+  }
+}
+
+// How long the calling thread is blocked by clearing a list: in place, and
+// with ClearAsync, which returns at once; Flush waits for the reclaimer.
+template <typename T, typename Make>
+void BenchClearAsyncOne(const char* name, size_t size, Make make) {
+  auto report = [&](const char* what, auto start) {
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-22s %-12s size=%-9zu %10.3f ms\n", name, what, size,
+                std::chrono::duration<double, std::milli>(finish - start)
+                    .count());
+  };
+  auto build = [&] {
+    auto list = std::make_unique<List<T>>();
+    for (size_t i = 0; i < size; ++i) {
+      list->PushBack(make(i));
+    }
+    return list;
+  };
+
+  auto list = build();
+  auto start = std::chrono::steady_clock::now();
+  list.reset();
+  report("in place", start);
+
+  ListReclaimer reclaimer;
+  list = build();
+  list->SetReclaimer(&reclaimer);
+  start = std::chrono::steady_clock::now();
+  list->ClearAsync();
+  report("ClearAsync", start);
+  list->PushBack(make(0));
+  start = std::chrono::steady_clock::now();
+  reclaimer.Flush();
+  report("Flush", start);
+}
+
+void BenchClearAsync(size_t size) {
+  BenchClearAsyncOne<long long>("List<long long>", size, [](size_t i) {
+    return static_cast<long long>(i);
+  });
+  BenchClearAsyncOne<std::string>("List<std::string>", size / 4,
+                                  [](size_t i) {
+                                    return std::string(40, 'a' + i % 26);
+                                  });
+}
+
+// std algorithms through const_iterator: dereferencing has to yield a
+// reference, otherwise every step copies the string.
+void BenchStdAlgorithms(size_t size, size_t rounds) {
+  List<std::string> list;
+  std::list<std::string> std_list;
+  for (size_t i = 0; i < size; ++i) {
+    list.PushBack(std::string(40, static_cast<char>('a' + i % 26)));
+    std_list.push_back(list.Back());
+  }
+  std::string missing(40, '#');
+  auto report = [&](const char* name, auto start, size_t result) {
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-26s size=%-9zu %8.2f ns/elem (%zu)\n", name, size,
+                std::chrono::duration<double, std::nano>(finish - start)
+                        .count() /
+                    static_cast<double>(size * rounds),
+                result);
+  };
+  auto length = [](size_t sum, const std::string& s) { return sum + s.size(); };
+
+  size_t result = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    result += std::accumulate(list.Cbegin(), list.Cend(), size_t{0}, length);
+  }
+  report("List std::accumulate", start, result);
+  result = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    result += std::accumulate(std_list.cbegin(), std_list.cend(), size_t{0},
+                              length);
+  }
+  report("std::list std::accumulate", start, result);
+
+  result = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    result += std::find(list.Cbegin(), list.Cend(), missing) == list.Cend();
+  }
+  report("List std::find", start, result);
+  result = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    result += std::find(std_list.cbegin(), std_list.cend(), missing) ==
+              std_list.cend();
+  }
+  report("std::list std::find", start, result);
+}
+
+void BenchSerialization(size_t size) {
+  List<long long> list;
+  for (size_t i = 0; i < size; ++i) {
+    list.PushBack(static_cast<long long>(i));
+  }
+  auto report = [size](const char* name, auto start, size_t elements) {
+    auto finish = std::chrono::steady_clock::now();
+    double ns =
+        std::chrono::duration<double, std::nano>(finish - start).count();
+    std::printf("%-22s size=%-9zu %8.3f ns/elem\n", name, elements,
+                ns / static_cast<double>(size));
+  };
+
+  std::stringstream stream;
+  auto start = std::chrono::steady_clock::now();
+  list.SerializeTo(stream);
+  report("SerializeTo", start, size);
+  std::string snapshot = stream.str();
+
+  std::istringstream by_element(snapshot);
+  start = std::chrono::steady_clock::now();
+  List<long long> pushed;
+  by_element.ignore(16);  // the header
+  long long value = 0;
+  while (by_element.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+    pushed.PushBack(value);
+  }
+  report("read + PushBack", start, pushed.Size());
+
+  std::istringstream bulk(snapshot);
+  start = std::chrono::steady_clock::now();
+  List<long long> loaded = List<long long>::Deserialize(bulk);
+  report("Deserialize", start, loaded.Size());
+
+  std::istringstream streamed(snapshot);
+  start = std::chrono::steady_clock::now();
+  List<long long>::Reader reader(streamed);
+  size_t total = 0;
+  while (reader.Remaining() > 0) {
+    total += reader.Next(1 << 16).Size();
+  }
+  report("Reader::Next(65536)", start, total);
+}
+
+void BenchParallel(size_t size, size_t rounds) {
+  List<long long> list;
+  for (size_t i = 0; i < size; ++i) {
+    list.PushBack(static_cast<long long>(i));
+  }
+  auto heavy = [](long long value) {
+    for (int i = 0; i < 16; ++i) {
+      value = value * 6364136223846793005LL + 1442695040888963407LL;
+    }
+    return value;
+  };
+  auto time = [size, rounds](const char* name, size_t threads, auto body) {
+    long long total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+      total += body();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    double ns =
+        std::chrono::duration<double, std::nano>(finish - start).count();
+    std::printf("%-22s threads=%-3zu %8.3f ns/elem (checksum %lld)\n", name,
+                threads, ns / static_cast<double>(size * rounds), total);
+  };
+  time("Accumulate", 1, [&list] { return list.Accumulate(0LL); });
+  for (size_t threads : {1, 2, 4, 8, 16}) {
+    time("ParallelReduce", threads, [&list, threads] {
+      return list.ParallelReduce(0LL, std::plus<>(), threads);
+    });
+    List<long long>::Segments segments = list.Split(threads);
+    time("ParallelReduce cached", threads, [&list, &segments] {
+      return list.ParallelReduce(0LL, std::plus<>(), segments);
+    });
+    time("TransformReduce + work", threads, [&list, &segments, &heavy] {
+      return list.ParallelTransformReduce(0LL, std::plus<>(), heavy,
+                                          segments);
+    });
+  }
+}
+
+void BenchPositionIndex(size_t size, size_t queries) {
+  List<long long> list;
+  for (size_t i = 0; i < size; ++i) {
+    list.PushBack(static_cast<long long>(i));
+  }
+  std::mt19937_64 random(42);
+  std::vector<size_t> positions(queries);
+  for (size_t& position : positions) {
+    position = random() % size;
+  }
+  for (size_t stride : {0, 16, 64, 256, 1024}) {
+    list.SetPositionIndexStride(stride);
+    // The first query builds the index.
+    auto build_start = std::chrono::steady_clock::now();
+    long long sum = list.At(0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t position : positions) {
+      sum += list.At(position);
+    }
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-22s stride=%-5zu %10.1f ns/query %8.2f ms build "
+                "%10zu index bytes (checksum %lld)\n",
+                "At", stride,
+                std::chrono::duration<double, std::nano>(finish - start)
+                        .count() /
+                    static_cast<double>(queries),
+                std::chrono::duration<double, std::milli>(start - build_start)
+                    .count(),
+                list.PositionIndexBytes(), sum);
+  }
+}
+
+void BenchSorted(size_t size, size_t linear_size) {
+  std::mt19937_64 random(42);
+  std::vector<long long> values(size);
+  for (long long& value : values) {
+    value = static_cast<long long>(random() % (size * 4));
+  }
+  auto report = [](const char* name, size_t count, auto start) {
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-22s size=%-9zu %10.1f ns/op\n", name, count,
+                std::chrono::duration<double, std::nano>(finish - start)
+                        .count() /
+                    static_cast<double>(count));
+  };
+
+  SortedList<long long> sorted;
+  auto start = std::chrono::steady_clock::now();
+  for (long long value : values) {
+    sorted.Insert(value);
+  }
+  report("SortedList insert", size, start);
+  std::multiset<long long> set;
+  start = std::chrono::steady_clock::now();
+  for (long long value : values) {
+    set.insert(value);
+  }
+  report("std::multiset insert", size, start);
+  List<long long> linear;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < linear_size; ++i) {
+    auto it = linear.Cbegin();
+    while (it != linear.Cend() && *it.operator->() < values[i]) {
+      ++it;
+    }
+    linear.Insert(it, values[i]);
+  }
+  report("List linear insert", linear_size, start);
+
+  size_t found = 0;
+  start = std::chrono::steady_clock::now();
+  for (long long value : values) {
+    found += sorted.Find(value + 1) != sorted.End() ? 1 : 0;
+  }
+  report("SortedList find", size, start);
+  start = std::chrono::steady_clock::now();
+  for (long long value : values) {
+    found += set.find(value + 1) != set.end() ? 1 : 0;
+  }
+  report("std::multiset find", size, start);
+  std::printf("(found %zu)\n", found);
+}
+
+// Lookups over twice the capacity in keys, skewed towards small keys;
+// a miss is followed by a Put, as a read-through cache would do.
+void BenchLru(size_t capacity, size_t ops) {
+  std::mt19937_64 random(42);
+  std::uniform_int_distribution<long long> uniform(
+      0, static_cast<long long>(capacity * 2) - 1);
+  std::vector<long long> keys(ops);
+  for (long long& key : keys) {
+    key = std::min(uniform(random), uniform(random));
+  }
+  auto report = [&](const char* name, auto start, size_t hits) {
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-22s capacity=%-9zu %8.1f ns/op  hit rate %.3f\n", name,
+                capacity,
+                std::chrono::duration<double, std::nano>(finish - start)
+                        .count() /
+                    static_cast<double>(ops),
+                static_cast<double>(hits) / static_cast<double>(ops));
+  };
+
+  {
+    LruCache<long long, long long> cache(capacity);
+    for (size_t i = 0; i < capacity; ++i) {
+      cache.Put(static_cast<long long>(i), 0);
+    }
+    cache.ResetStats();
+    auto start = std::chrono::steady_clock::now();
+    for (long long key : keys) {
+      if (cache.Get(key) == nullptr) {
+        cache.Put(key, key);
+      }
+    }
+    report("LruCache", start, cache.Stats().hits);
+  }
+  {
+    using Entries = std::list<std::pair<long long, long long>>;
+    Entries entries;
+    std::unordered_map<long long, Entries::iterator> index;
+    index.reserve(capacity);
+    for (size_t i = 0; i < capacity; ++i) {
+      entries.emplace_front(static_cast<long long>(i), 0);
+      index.emplace(static_cast<long long>(i), entries.begin());
+    }
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long long key : keys) {
+      auto found = index.find(key);
+      if (found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        ++hits;
+        continue;
+      }
+      index.erase(entries.back().first);
+      entries.pop_back();
+      entries.emplace_front(key, key);
+      index.emplace(key, entries.begin());
+    }
+    report("std::list + map", start, hits);
+  }
+}
+
+#if LIST_POSIX_IO
+void BenchPersistent(size_t size) {
+  char path[] = "/tmp/list_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+  {
+    PersistentList<long long> list(path);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < size; ++i) {
+      list.PushBack(static_cast<long long>(i));
+    }
+    auto finish = std::chrono::steady_clock::now();
+    std::printf("%-22s size=%-9zu %8.3f ns/elem\n", "PersistentList push",
+                size,
+                std::chrono::duration<double, std::nano>(finish - start)
+                        .count() /
+                    static_cast<double>(size));
+  }
+  auto start = std::chrono::steady_clock::now();
+  PersistentList<long long> list(path);
+  auto opened = std::chrono::steady_clock::now();
+  long long sum = 0;
+  for (auto it = list.Cbegin(); it != list.Cend(); ++it) {
+    sum += *it;
+  }
+  auto finish = std::chrono::steady_clock::now();
+  std::printf("%-22s size=%-9zu %8.3f us open, %8.3f ns/elem first walk "
+              "(checksum %lld)\n",
+              "PersistentList reopen", list.Size(),
+              std::chrono::duration<double, std::micro>(opened - start).count(),
+              std::chrono::duration<double, std::nano>(finish - opened)
+                      .count() /
+                  static_cast<double>(list.Size()),
+              sum);
+  unlink(path);
+}
+#endif
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::strcmp(argv[1], "--suite") == 0) {
+    return RunSuite(argc, argv);
+  }
+  constexpr size_t kSize = 1'000'000;
+  constexpr size_t kRounds = 20;
+  BenchTraversal<List<int, ByteCountingAllocator<int>>>("List", kSize,
+                                                        kRounds);
+  BenchTraversal<UnrolledList<int, ByteCountingAllocator<int>>>(
+      "UnrolledList", kSize, kRounds);
+  BenchTraversal<XorList<int, ByteCountingAllocator<int>>>("XorList", kSize,
+                                                           kRounds);
+
+  BenchPrefetch(1 << 22, 3);
+  BenchCompact(1 << 22, 3);
+  BenchTeardown();
+  BenchClearAsync(1 << 24);
+  BenchSerialization(1 << 22);
+  BenchParallel(1 << 24, 3);
+  BenchPositionIndex(1 << 20, 1000);
+  BenchStdAlgorithms(1 << 20, 5);
+  BenchSorted(1 << 20, 1 << 14);
+  for (size_t capacity : {100'000, 1'000'000, 10'000'000}) {
+    BenchLru(capacity, 4'000'000);
+  }
+#if LIST_POSIX_IO
+  BenchPersistent(1 << 22);
+#endif
+
+  for (int producers : {1, 2, 4, 8}) {
+    BenchQueues(producers, 200'000);
+  }
+
+  for (int threads = 1; threads <= 32; threads *= 2) {
+    BenchConcurrentLists(threads);
+  }
+  return 0;
+}
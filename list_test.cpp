@@ -7,6 +7,25 @@
 #include "memory_utils.hpp"
 #include "catch.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
 size_t MemoryManager::type_new_allocated = 0;
 size_t MemoryManager::type_new_deleted = 0;
 size_t MemoryManager::allocator_allocated = 0;
@@ -313,3 +332,1857 @@ REQUIRE(*l.Begin()->copy_c == 0);
 REQUIRE(*l.Begin()->move_c == 1);
 REQUIRE(*l.Begin()->copy_c == 0);
 }
+
+TEST_CASE("Node cache", "[List: node cache]") {
+SetupTest();
+List<int, AllocatorWithCount<int>> lst;
+REQUIRE(lst.NodeCacheLimit() == 0);
+  lst.ReserveNodes(4);
+REQUIRE(lst.NodeCacheLimit() == 4);
+REQUIRE(lst.CachedNodes() == 4);
+
+const size_t allocated = MemoryManager::allocator_allocated;
+const size_t deallocated = MemoryManager::allocator_deallocated;
+for (int i = 0; i < 1000; ++i) {
+  lst.EmplaceBack(i);
+  lst.EmplaceBack(i + 1);
+  lst.PopFront();
+  lst.PopFront();
+}
+REQUIRE(lst.Empty());
+REQUIRE(lst.CachedNodes() == 4);
+REQUIRE(MemoryManager::allocator_allocated == allocated);
+REQUIRE(MemoryManager::allocator_deallocated == deallocated);
+REQUIRE(MemoryManager::allocator_constructed == 2000);
+REQUIRE(MemoryManager::allocator_destroyed == 2000);
+
+  lst.SetNodeCacheLimit(1);
+REQUIRE(lst.CachedNodes() == 1);
+  lst.ShrinkToFit();
+REQUIRE(lst.CachedNodes() == 0);
+REQUIRE(lst.NodeCacheLimit() == 1);
+}
+
+TEST_CASE("Node cache is disabled by default", "[List: node cache]") {
+SetupTest();
+List<int, AllocatorWithCount<int>> lst;
+  lst.PushBack(1);
+  lst.PopBack();
+REQUIRE(lst.CachedNodes() == 0);
+  lst.PushBack(2);
+  lst.PopBack();
+REQUIRE(MemoryManager::allocator_deallocated == MemoryManager::allocator_allocated);
+}
+
+TEST_CASE("Fill constructors allocate nodes in one slab", "[List: slab]") {
+SetupTest();
+constexpr size_t kSize = 1000;
+{
+List<int, AllocatorWithCount<int>> lst(kSize, 7);
+// slab table and bookkeeping, and the slab itself
+REQUIRE(MemoryManager::allocator_allocated == 3);
+REQUIRE(MemoryManager::allocator_constructed == kSize);
+
+const int* previous = nullptr;
+std::ptrdiff_t stride = 0;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+const int* current = &*it;
+if (previous != nullptr) {
+if (stride == 0) {
+  stride = current - previous;
+}
+REQUIRE(current - previous == stride);
+REQUIRE(stride > 0);
+}
+previous = current;
+}
+
+List<int, AllocatorWithCount<int>> copy = lst;
+REQUIRE(MemoryManager::allocator_allocated == 6);
+REQUIRE(AreListsEqual(lst, copy));
+
+for (size_t i = 0; i < kSize / 2; ++i) {
+  lst.PopFront();
+  lst.PopBack();
+}
+REQUIRE(lst.Empty());
+for (size_t i = 0; i < kSize; ++i) {
+  lst.PushBack(static_cast<int>(i));
+}
+REQUIRE(lst.Size() == kSize);
+REQUIRE(MemoryManager::allocator_allocated == 6);
+}
+REQUIRE(MemoryManager::allocator_deallocated == 6);
+REQUIRE(MemoryManager::allocator_destroyed == MemoryManager::allocator_constructed);
+}
+
+TEST_CASE("UnrolledList basic func", "[UnrolledList]") {
+SetupTest();
+UnrolledList<int, std::allocator<int>, 4> lst;
+REQUIRE(lst.Empty());
+for (int i = 0; i < 10; ++i) {
+  lst.PushBack(i);
+  lst.PushFront(-i - 1);
+}
+REQUIRE(lst.Size() == 20);
+REQUIRE(lst.Front() == -10);
+REQUIRE(lst.Back() == 9);
+
+int expected = -10;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+REQUIRE(*it == expected);
+++expected;
+}
+auto it = lst.End();
+for (int i = 9; i >= -10; --i) {
+  --it;
+REQUIRE(*it == i);
+}
+
+UnrolledList<int, std::allocator<int>, 4> copy = lst;
+REQUIRE(copy.Size() == 20);
+for (int i = 0; i < 15; ++i) {
+  lst.PopFront();
+}
+REQUIRE(lst.Front() == 5);
+  lst.PopBack();
+REQUIRE(lst.Back() == 8);
+REQUIRE(lst.Size() == 4);
+
+UnrolledList<int, std::allocator<int>, 4> moved = std::move(copy);
+REQUIRE(copy.Empty());
+REQUIRE(moved.Size() == 20);
+  copy = moved;
+REQUIRE(copy.Size() == 20);
+  lst.Swap(moved);
+REQUIRE(lst.Size() == 20);
+REQUIRE(moved.Size() == 4);
+}
+
+TEST_CASE("UnrolledList allocator and exception safety", "[UnrolledList]") {
+SetupTest();
+{
+UnrolledList<TypeWithFancyNewDeleteOperators,
+             AllocatorWithCount<TypeWithFancyNewDeleteOperators>, 8> lst(20);
+REQUIRE(lst.Size() == 20);
+REQUIRE(MemoryManager::type_new_allocated == 0);
+REQUIRE(MemoryManager::allocator_allocated == 3);
+REQUIRE(MemoryManager::allocator_constructed == 20);
+}
+REQUIRE(MemoryManager::allocator_deallocated == 3);
+REQUIRE(MemoryManager::allocator_destroyed == 20);
+
+Accountant::reset();
+ThrowingAccountant::need_throw = true;
+try {
+UnrolledList<ThrowingAccountant> lst(8);
+} catch (...) {
+REQUIRE(Accountant::ctor_calls == 4);
+REQUIRE(Accountant::dtor_calls == 4);
+}
+ThrowingAccountant::need_throw = false;
+}
+
+TEST_CASE("Splice", "[List: splice]") {
+SetupTest();
+List<int, AllocatorWithCount<int>> first = {1, 2, 3};
+List<int, AllocatorWithCount<int>> second;
+  second.PushBack(4);
+  second.PushBack(5);
+  second.PushBack(6);
+const size_t allocated = MemoryManager::allocator_allocated;
+
+  first.Splice(first.End(), second);
+REQUIRE(first.Size() == 6);
+REQUIRE(second.Empty());
+bool empty_range = second.Begin() == second.End();
+REQUIRE(empty_range);
+
+  second.Splice(second.End(), first, first.Begin());
+REQUIRE(second.Size() == 1);
+REQUIRE(second.Front() == 1);
+REQUIRE(first.Front() == 2);
+
+auto from = first.Begin();
+++from;
+auto to = from;
+++to;
+++to;
+  second.Splice(second.Begin(), first, from, to);
+REQUIRE(second.Size() == 3);
+REQUIRE(first.Size() == 3);
+
+std::string s;
+for (int x : second) {
+s += std::to_string(x);
+}
+REQUIRE(s == "341");
+s.clear();
+for (int x : first) {
+s += std::to_string(x);
+}
+REQUIRE(s == "256");
+
+  first.Splice(first.Begin(), first, --first.End());
+REQUIRE(first.Front() == 6);
+REQUIRE(first.Back() == 5);
+
+// only the slab table of second, which now refers to the slab of first
+REQUIRE(MemoryManager::allocator_allocated == allocated + 1);
+REQUIRE(MemoryManager::allocator_constructed == 6);
+}
+
+TEST_CASE("Spliced slab nodes outlive their list", "[List: splice]") {
+SetupTest();
+List<int, AllocatorWithCount<int>> target;
+{
+List<int, AllocatorWithCount<int>> source(100, 1);
+  target.Splice(target.End(), source, source.Begin(), source.End());
+  source.PushBack(2);
+  target.PopBack();
+}
+REQUIRE(target.Size() == 99);
+for (int i = 0; i < 100; ++i) {
+  target.PopFront();
+  target.PushBack(i);
+}
+REQUIRE(target.Back() == 99);
+}
+
+TEST_CASE("Lists sharing slabs are used on different threads", "[List: splice]") {
+constexpr int kLists = 8;
+std::vector<List<int>> lists;
+for (int i = 0; i < kLists; ++i) {
+  lists.emplace_back(100, i);
+}
+// Every list takes a node of every other one, so all slabs are shared.
+for (int i = 0; i < kLists; ++i) {
+  for (int j = 0; j < kLists; ++j) {
+    if (i != j) {
+      lists[i].Splice(lists[i].Cend(), lists[j], lists[j].Cbegin());
+    }
+  }
+}
+std::vector<size_t> sizes(kLists);
+std::vector<std::thread> threads;
+for (int i = 0; i < kLists; ++i) {
+  threads.emplace_back([&lists, &sizes, i] {
+    List<int>& list = lists[i];
+    for (int k = 0; k < 1000; ++k) {
+      list.PopFront();
+      list.PushBack(k);
+    }
+    list.Compact();
+    sizes[i] = list.Size();
+    List<int> dying(std::move(list));
+  });
+}
+for (std::thread& thread : threads) {
+  thread.join();
+}
+for (int i = 0; i < kLists; ++i) {
+REQUIRE(sizes[i] == 100);
+REQUIRE(lists[i].Empty());
+}
+}
+
+TEST_CASE("Merge and Sort", "[List: sort]") {
+SetupTest();
+List<std::pair<int, int>, AllocatorWithCount<std::pair<int, int>>> lst;
+for (int i = 0; i < 1000; ++i) {
+  lst.PushBack(std::make_pair((i * 7919) % 13, i));
+}
+const size_t allocated = MemoryManager::allocator_allocated;
+auto by_key = [](const std::pair<int, int>& lhs,
+                 const std::pair<int, int>& rhs) {
+  return lhs.first < rhs.first;
+};
+  lst.Sort(by_key);
+REQUIRE(lst.Size() == 1000);
+REQUIRE(std::is_sorted(lst.Begin(), lst.End()));
+REQUIRE(MemoryManager::allocator_allocated == allocated);
+
+List<std::pair<int, int>, AllocatorWithCount<std::pair<int, int>>> other;
+for (int i = 0; i < 13; ++i) {
+  other.PushBack(std::make_pair(i, -1));
+}
+  lst.Merge(other, by_key);
+REQUIRE(other.Empty());
+REQUIRE(lst.Size() == 1013);
+REQUIRE(std::is_sorted(lst.Begin(), lst.End(), by_key));
+REQUIRE(lst.Back().second == -1);
+
+List<int> numbers = {5, 3, 1, 4, 2};
+  numbers.Sort();
+std::string s;
+for (int x : numbers) {
+s += std::to_string(x);
+}
+REQUIRE(s == "12345");
+}
+
+TEST_CASE("Sort with throwing comparator", "[List: sort]") {
+List<int> lst;
+for (int i = 0; i < 100; ++i) {
+  lst.PushFront(i);
+}
+int calls = 0;
+try {
+  lst.Sort([&calls](int lhs, int rhs) {
+    if (++calls == 200) {
+      throw std::string("comparator");
+    }
+    return lhs < rhs;
+  });
+} catch (...) {
+}
+REQUIRE(lst.Size() == 100);
+int sum = 0;
+size_t count = 0;
+for (int x : lst) {
+sum += x;
+++count;
+}
+REQUIRE(count == 100);
+REQUIRE(sum == 4950);
+  lst.Sort();
+REQUIRE(std::is_sorted(lst.Begin(), lst.End()));
+}
+
+TEST_CASE("ParallelSort", "[List: sort]") {
+SetupTest();
+using Pair = std::pair<int, int>;
+auto by_key = [](const Pair& lhs, const Pair& rhs) {
+  return lhs.first < rhs.first;
+};
+List<Pair, AllocatorWithCount<Pair>> lst;
+List<Pair> expected;
+for (int i = 0; i < 10007; ++i) {
+  lst.PushBack(std::make_pair((i * 7919) % 101, i));
+  expected.PushBack(std::make_pair((i * 7919) % 101, i));
+}
+const size_t allocated = MemoryManager::allocator_allocated;
+  lst.ParallelSort(by_key, 5, 16);
+  expected.Sort(by_key);
+REQUIRE(MemoryManager::allocator_allocated == allocated);
+REQUIRE(lst.Size() == expected.Size());
+auto it = expected.Begin();
+for (const Pair& value : lst) {
+REQUIRE(value == *it);
+++it;
+}
+REQUIRE(lst.Front() == expected.Front());
+REQUIRE(lst.Back() == expected.Back());
+auto back = lst.End();
+--back;
+REQUIRE(*back == expected.Back());
+
+// A thread id can be reused after a join, thread_local storage can not.
+std::atomic<size_t> threads_seen = 0;
+auto by_value = [&threads_seen](const Pair& lhs, const Pair& rhs) {
+  thread_local bool counted = false;
+  if (!counted) {
+    counted = true;
+    ++threads_seen;
+  }
+  return lhs.second < rhs.second;
+};
+  lst.ParallelSort(by_value, 5, 16);
+int next = 0;
+for (const Pair& value : lst) {
+REQUIRE(value.second == next++);
+}
+// The merge levels reuse the threads that sorted the pieces.
+REQUIRE(threads_seen <= 5);
+
+std::atomic<int> calls = 0;
+auto throwing = [&calls](const Pair& lhs, const Pair& rhs) {
+  if (++calls == 30000) {
+    throw std::runtime_error("compare");
+  }
+  return lhs.first < rhs.first;
+};
+REQUIRE_THROWS_AS(lst.ParallelSort(throwing, 5, 16), std::runtime_error);
+REQUIRE(lst.Size() == 10007);
+long long total = 0;
+for (const Pair& value : lst) {
+total += value.second;
+}
+REQUIRE(total == 10006LL * 10007 / 2);
+}
+
+TEST_CASE("MpscQueue with many producers", "[MpscQueue]") {
+SetupTest();
+constexpr int kProducers = 4;
+constexpr int kPerProducer = 20000;
+{
+MpscQueue<std::pair<int, int>, AllocatorWithCount<std::pair<int, int>>> queue;
+std::vector<std::thread> producers;
+for (int p = 0; p < kProducers; ++p) {
+  producers.emplace_back([&queue, p] {
+    for (int i = 0; i < kPerProducer; ++i) {
+      queue.EmplaceBack(p, i);
+    }
+  });
+}
+
+std::vector<int> next_expected(kProducers, 0);
+List<std::pair<int, int>> drained;
+int received = 0;
+bool in_order = true;
+while (received < kProducers * kPerProducer) {
+std::pair<int, int> value;
+if (received % 2 == 0 && queue.TryPopFront(value)) {
+in_order = in_order && value.second == next_expected[value.first]++;
+++received;
+continue;
+}
+  queue.DrainTo(drained);
+while (!drained.Empty()) {
+value = drained.Front();
+  drained.PopFront();
+in_order = in_order && value.second == next_expected[value.first]++;
+++received;
+}
+}
+for (auto& producer : producers) {
+  producer.join();
+}
+REQUIRE(in_order);
+REQUIRE(queue.Empty());
+for (int p = 0; p < kProducers; ++p) {
+REQUIRE(next_expected[p] == kPerProducer);
+}
+
+  queue.PushBack(std::make_pair(-1, -1));
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("ConcurrentList", "[ConcurrentList]") {
+SetupTest();
+constexpr int kThreads = 4;
+constexpr int kPerThread = 300;
+{
+ConcurrentList<int, AllocatorWithCount<int>> lst;
+for (int t = 0; t <= kThreads; ++t) {
+  lst.EmplaceBack(t * kPerThread * 10);
+}
+std::vector<std::thread> threads;
+for (int t = 0; t < kThreads; ++t) {
+  threads.emplace_back([&lst, t] {
+    const int base = t * kPerThread * 10;
+    for (int i = 1; i <= kPerThread; ++i) {
+      const int key = base + i * 2;
+      lst.EmplaceBefore([key](int value) { return value > key; }, key);
+      lst.EmplaceBefore([key](int value) { return value > key; }, key + 1);
+      lst.Erase(key + 1);
+    }
+    for (int i = 1; i <= kPerThread; i += 2) {
+      lst.Erase(base + i * 2);
+    }
+  });
+}
+for (auto& thread : threads) {
+  thread.join();
+}
+REQUIRE(lst.Size() == kThreads + 1 + kThreads * kPerThread / 2);
+
+int previous = -1;
+bool sorted = true;
+  lst.ForEach([&previous, &sorted](int value) {
+    sorted = sorted && previous < value;
+    previous = value;
+  });
+REQUIRE(sorted);
+REQUIRE(lst.Contains(4));
+REQUIRE_FALSE(lst.Contains(2));
+int found = 0;
+REQUIRE(lst.FindIf([](int value) { return value >= kPerThread * 10; }, found));
+REQUIRE(found == kPerThread * 10);
+REQUIRE(lst.EraseIf([](int value) { return value % 2 == 0; }));
+REQUIRE_FALSE(lst.Contains(0));
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("ConcurrentList appends at the back", "[ConcurrentList]") {
+SetupTest();
+{
+ConcurrentList<int, AllocatorWithCount<int>> lst;
+auto Contents = [&lst] {
+  std::vector<int> values;
+  lst.ForEach([&values](int value) { values.push_back(value); });
+  return values;
+};
+  lst.EmplaceBack(1);
+  lst.EmplaceBack(2);
+  lst.EmplaceBack(3);
+  lst.Erase(3);
+  lst.EmplaceBack(4);
+REQUIRE(Contents() == std::vector<int>{1, 2, 4});
+  lst.Erase(1);
+  lst.Erase(2);
+  lst.Erase(4);
+  lst.EmplaceBack(5);
+  lst.EmplaceFront(0);
+  lst.EmplaceBack(6);
+REQUIRE(Contents() == std::vector<int>{0, 5, 6});
+
+constexpr int kThreads = 4;
+constexpr int kPerThread = 500;
+std::vector<std::thread> threads;
+for (int t = 0; t < kThreads; ++t) {
+  threads.emplace_back([&lst, t] {
+    for (int i = 0; i < kPerThread; ++i) {
+      lst.EmplaceBack(100 + t * kPerThread + i);
+      if (i % 2 == 1) {
+        lst.Erase(100 + t * kPerThread + i);
+      }
+    }
+  });
+}
+for (auto& thread : threads) {
+  thread.join();
+}
+REQUIRE(lst.Size() == 3 + kThreads * kPerThread / 2);
+// Appends of one thread keep their order.
+std::vector<int> last(kThreads, -1);
+bool ordered = true;
+for (int value : Contents()) {
+  if (value < 100) {
+    continue;
+  }
+  int t = (value - 100) / kPerThread;
+  ordered = ordered && last[t] < value && value % 2 == 0;
+  last[t] = value;
+}
+REQUIRE(ordered);
+  lst.EmplaceBack(-1);
+REQUIRE(Contents().back() == -1);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+}
+
+TEST_CASE("ConcurrentList readers run alongside writers", "[ConcurrentList]") {
+SetupTest();
+constexpr int kKeys = 64;
+{
+ConcurrentList<int, AllocatorWithCount<int>> lst;
+for (int key = 0; key < kKeys; key += 2) {
+  lst.EmplaceBack(key);
+}
+std::atomic<bool> stop{false};
+std::vector<std::thread> threads;
+for (int t = 0; t < 2; ++t) {
+  threads.emplace_back([&lst, t] {
+    for (int i = 0; i < 2000; ++i) {
+      const int key = 1 + 2 * (2 * ((i * 7) % (kKeys / 4)) + t);
+      lst.EmplaceBefore([key](int value) { return value > key; }, key);
+      lst.Erase(key);
+    }
+  });
+}
+std::atomic<bool> sorted{true};
+for (int t = 0; t < 2; ++t) {
+  threads.emplace_back([&lst, &stop, &sorted] {
+    while (!stop.load()) {
+      for (int key = 0; key < kKeys; key += 2) {
+        if (!lst.Contains(key)) {
+          sorted = false;
+        }
+      }
+      int found = -1;
+      if (!lst.FindIf([](int value) { return value >= kKeys - 2; }, found) || found != kKeys - 2) {
+        sorted = false;
+      }
+      int previous = -1;
+      lst.ForEach([&previous, &sorted](int value) {
+        if (value <= previous) {
+          sorted = false;
+        }
+        previous = value;
+      });
+    }
+  });
+}
+threads[0].join();
+threads[1].join();
+stop = true;
+threads[2].join();
+threads[3].join();
+REQUIRE(sorted);
+REQUIRE(lst.Size() == kKeys / 2);
+// Erased nodes are reclaimed as the list goes, not only by the destructor.
+for (int i = 0; i < 1000; ++i) {
+  lst.EmplaceFront(-1);
+  lst.Erase(-1);
+}
+REQUIRE(MemoryManager::allocator_allocated - MemoryManager::allocator_deallocated <= kKeys / 2 + 2);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+}
+
+TEST_CASE("XorList", "[XorList]") {
+SetupTest();
+{
+XorList<int, AllocatorWithCount<int>> lst;
+for (int i = 0; i < 10; ++i) {
+  lst.PushBack(i);
+  lst.PushFront(-i - 1);
+}
+REQUIRE(lst.Size() == 20);
+REQUIRE(lst.Front() == -10);
+REQUIRE(lst.Back() == 9);
+int expected = -10;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+  REQUIRE(*it == expected++);
+}
+auto it = lst.End();
+for (int i = 9; i >= -10; --i) {
+  --it;
+  REQUIRE(*it == i);
+}
+  lst.PopBack();
+  lst.PopFront();
+REQUIRE(lst.Front() == -9);
+REQUIRE(lst.Back() == 8);
+
+XorList<int, AllocatorWithCount<int>> copy = lst;
+XorList<int, AllocatorWithCount<int>> moved = std::move(lst);
+REQUIRE(lst.Empty());
+REQUIRE(moved.Size() == 18);
+  moved.PushBack(100);
+REQUIRE(moved.Back() == 100);
+  copy.Swap(moved);
+REQUIRE(copy.Size() == 19);
+REQUIRE(moved.Size() == 18);
+expected = -9;
+for (auto it = moved.Cbegin(); it != moved.Cend(); ++it) {
+  REQUIRE(*it == expected++);
+}
+while (!copy.Empty()) {
+  copy.PopBack();
+}
+  copy.PushFront(1);
+REQUIRE(copy.Front() == 1);
+REQUIRE(copy.Back() == 1);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+struct Pooled {
+  explicit Pooled(int value) : value(value) {}
+
+  int value;
+  ListHook ready;
+  ListHook busy;
+};
+
+TEST_CASE("IntrusiveList", "[IntrusiveList]") {
+SetupTest();
+std::vector<Pooled> pool;
+for (int i = 0; i < 8; ++i) {
+  pool.emplace_back(i);
+}
+IntrusiveList<Pooled, &Pooled::ready> ready;
+IntrusiveList<Pooled, &Pooled::busy> busy;
+for (auto& object : pool) {
+  ready.PushBack(object);
+}
+  busy.PushFront(pool[2]);
+  busy.PushFront(pool[5]);
+REQUIRE(ready.Size() == 8);
+REQUIRE(busy.Front().value == 5);
+REQUIRE(busy.Back().value == 2);
+
+  ready.Erase(pool[2]);
+  ready.Erase(pool[0]);
+  ready.PopBack();
+REQUIRE(ready.Size() == 5);
+REQUIRE_FALSE(pool[0].ready.Linked());
+REQUIRE(pool[2].busy.Linked());
+int expected[] = {1, 3, 4, 5, 6};
+int index = 0;
+for (auto it = ready.Begin(); it != ready.End(); ++it) {
+  REQUIRE(it->value == expected[index++]);
+}
+REQUIRE(&*ready.IteratorTo(pool[4]) == &pool[4]);
+
+IntrusiveList<Pooled, &Pooled::ready> moved = std::move(ready);
+REQUIRE(ready.Empty());
+REQUIRE(moved.Front().value == 1);
+REQUIRE(moved.Back().value == 6);
+  ready.PushBack(pool[0]);
+  ready.Swap(moved);
+REQUIRE(ready.Size() == 5);
+REQUIRE(moved.Front().value == 0);
+  ready.Clear();
+REQUIRE_FALSE(pool[3].ready.Linked());
+REQUIRE(pool[0].ready.Linked());
+}
+
+struct Shape {
+  virtual ~Shape() = default;
+  [[nodiscard]] virtual int Sides() const = 0;
+
+  std::string name;
+};
+
+struct Square : Shape {
+  [[nodiscard]] int Sides() const override { return 4; }
+
+  ListHook hook;
+};
+
+TEST_CASE("IntrusiveList links objects that are not standard-layout",
+          "[IntrusiveList]") {
+static_assert(!std::is_standard_layout_v<Square>);
+std::vector<Square> squares(3);
+IntrusiveList<Square, &Square::hook> list;
+for (auto& square : squares) {
+  square.name = "square";
+    list.PushFront(square);
+}
+REQUIRE(&list.Front() == &squares[2]);
+REQUIRE(&list.Back() == &squares[0]);
+for (auto it = list.Begin(); it != list.End(); ++it) {
+  REQUIRE(it->Sides() == 4);
+  REQUIRE(it->name == "square");
+}
+  list.Erase(squares[1]);
+REQUIRE(&*++list.Begin() == &squares[0]);
+}
+
+TEST_CASE("Empty lists, moves and Swap do not allocate", "[List: sentinel]") {
+SetupTest();
+auto Contents = [](const List<int, AllocatorWithCount<int>>& lst) {
+  return std::vector<int>(lst.Cbegin(), lst.Cend());
+};
+{
+List<int, AllocatorWithCount<int>> empty;
+List<int, AllocatorWithCount<int>> moved_empty = std::move(empty);
+REQUIRE(MemoryManager::allocator_allocated == 0);
+REQUIRE(Contents(moved_empty).empty());
+
+List<int, AllocatorWithCount<int>> first{1, 2, 3};
+List<int, AllocatorWithCount<int>> second{4, 5};
+const size_t allocated = MemoryManager::allocator_allocated;
+
+List<int, AllocatorWithCount<int>> moved = std::move(first);
+REQUIRE(first.Empty());
+REQUIRE(Contents(moved) == std::vector<int>{1, 2, 3});
+  first.PushBack(7);
+REQUIRE(MemoryManager::allocator_allocated == allocated + 1);
+  first.PopBack();
+
+  moved.Swap(second);
+REQUIRE(Contents(moved) == std::vector<int>{4, 5});
+REQUIRE(Contents(second) == std::vector<int>{1, 2, 3});
+  moved.Swap(empty);
+REQUIRE(moved.Empty());
+REQUIRE(Contents(empty) == std::vector<int>{4, 5});
+
+  moved = std::move(second);
+REQUIRE(second.Empty());
+REQUIRE(Contents(moved) == std::vector<int>{1, 2, 3});
+int expected = 3;
+for (auto it = --moved.End(); expected > 0; --it) {
+  REQUIRE(*it == expected--);
+}
+REQUIRE(MemoryManager::allocator_allocated == allocated + 1);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+}
+
+TEST_CASE("Stats", "[List: stats]") {
+List<int> lst;
+  lst.ReserveNodes(2);
+for (int i = 0; i < 10; ++i) {
+  lst.PushBack(i);
+}
+  lst.PopFront();
+ListStats stats = lst.Stats();
+#if LIST_ENABLE_STATS
+REQUIRE(stats.enabled);
+REQUIRE(stats.size == 9);
+REQUIRE(stats.peak_size == 10);
+REQUIRE(stats.cached_nodes == 1);
+REQUIRE(stats.make_node_calls == 10);
+REQUIRE(stats.node_allocations == 10);
+REQUIRE(stats.node_deallocations == 0);
+REQUIRE(stats.bytes_held % 10 == 0);
+REQUIRE(stats.bytes_held >= 10 * 2 * sizeof(void*));
+
+List<int> moved = std::move(lst);
+REQUIRE(moved.Stats().make_node_calls == 10);
+REQUIRE(lst.Stats().make_node_calls == 0);
+#if LIST_STATS_LATENCY
+REQUIRE(stats.emplace_back_latency.count == 10);
+REQUIRE(stats.pop_front_latency.count == 1);
+#endif
+#else
+REQUIRE_FALSE(stats.enabled);
+REQUIRE(stats.make_node_calls == 0);
+REQUIRE(stats.bytes_held == 0);
+#endif
+}
+
+struct ThrowOnCopy {
+  static int copies_left;
+
+  explicit ThrowOnCopy(int value) : value(value) {}
+  ThrowOnCopy(const ThrowOnCopy& other) : value(other.value) {
+    if (copies_left-- == 0) {
+      throw std::runtime_error("copy");
+    }
+  }
+  ThrowOnCopy& operator=(const ThrowOnCopy&) = default;
+
+  int value;
+};
+
+int ThrowOnCopy::copies_left = 0;
+
+struct ThrowOnAssign {
+  static int assignments_left;
+
+  explicit ThrowOnAssign(int value) : value(value) {}
+  ThrowOnAssign(const ThrowOnAssign&) = default;
+  ThrowOnAssign& operator=(const ThrowOnAssign& other) {
+    if (assignments_left-- == 0) {
+      throw std::runtime_error("assign");
+    }
+    value = other.value;
+    return *this;
+  }
+
+  int value;
+};
+
+int ThrowOnAssign::assignments_left = 0;
+
+TEST_CASE("Insert and Erase in the middle", "[List: insert/erase]") {
+SetupTest();
+auto Contents = [](const List<int, AllocatorWithCount<int>>& lst) {
+  return std::vector<int>(lst.Cbegin(), lst.Cend());
+};
+{
+List<int, AllocatorWithCount<int>> lst;
+auto it = lst.Insert(lst.Cend(), 5);
+REQUIRE(*it == 5);
+  lst.Emplace(lst.Cbegin(), 1);
+  lst.Insert(it, 3);
+REQUIRE(Contents(lst) == std::vector<int>{1, 3, 5});
+
+std::vector<int> source{2, 2, 2};
+auto inserted = lst.InsertRange(++lst.Cbegin(), source.begin(), source.end());
+REQUIRE(*inserted == 2);
+REQUIRE(Contents(lst) == std::vector<int>{1, 2, 2, 2, 3, 5});
+auto unchanged = lst.InsertRange(lst.Cend(), source.end(), source.end());
+bool at_end = unchanged == lst.End();
+REQUIRE(at_end);
+
+auto after = lst.Erase(lst.Cbegin());
+REQUIRE(*after == 2);
+REQUIRE(lst.Front() == 2);
+auto last = lst.End();
+--last;
+after = lst.Erase(last);
+at_end = after == lst.End();
+REQUIRE(at_end);
+REQUIRE(lst.Back() == 3);
+
+auto first = lst.Begin();
+auto stop = first;
+++stop;
+++stop;
+++stop;
+after = lst.Erase(first, stop);
+REQUIRE(*after == 3);
+REQUIRE(Contents(lst) == std::vector<int>{3});
+after = lst.Erase(lst.Cbegin(), lst.Cend());
+REQUIRE(lst.Empty());
+  lst.PushBack(4);
+REQUIRE(Contents(lst) == std::vector<int>{4});
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("InsertRange gives the strong guarantee", "[List: insert/erase]") {
+SetupTest();
+{
+List<ThrowOnCopy, AllocatorWithCount<ThrowOnCopy>> lst;
+  lst.EmplaceBack(1);
+  lst.EmplaceBack(2);
+ThrowOnCopy::copies_left = 100;
+std::vector<ThrowOnCopy> source;
+for (int i = 10; i < 15; ++i) {
+  source.emplace_back(i);
+}
+ThrowOnCopy::copies_left = 3;
+REQUIRE_THROWS(lst.InsertRange(++lst.Cbegin(), source.begin(), source.end()));
+REQUIRE(lst.Size() == 2);
+REQUIRE(lst.Front().value == 1);
+REQUIRE(lst.Back().value == 2);
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated + 2);
+ThrowOnCopy::copies_left = 100;
+  lst.InsertRange(++lst.Cbegin(), source.begin(), source.end());
+REQUIRE(lst.Size() == 7);
+REQUIRE((++lst.Begin())->value == 10);
+REQUIRE(lst.Back().value == 2);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+}
+
+TEST_CASE("Copy assignment and Assign reuse nodes", "[List: assign]") {
+SetupTest();
+auto Contents = [](const List<int, AllocatorWithCount<int>>& lst) {
+  return std::vector<int>(lst.Cbegin(), lst.Cend());
+};
+{
+List<int, AllocatorWithCount<int>> lst;
+List<int, AllocatorWithCount<int>> other;
+for (int i = 0; i < 1000; ++i) {
+  lst.PushBack(i);
+  other.PushBack(-i);
+}
+size_t allocated = MemoryManager::allocator_allocated;
+size_t deallocated = MemoryManager::allocator_deallocated;
+lst = other;
+REQUIRE(Contents(lst) == Contents(other));
+REQUIRE(MemoryManager::allocator_allocated == allocated);
+REQUIRE(MemoryManager::allocator_deallocated == deallocated);
+
+  lst.Assign(10, 7);
+REQUIRE(Contents(lst) == std::vector<int>(10, 7));
+REQUIRE(MemoryManager::allocator_deallocated == deallocated + 990);
+
+std::vector<int> source{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+allocated = MemoryManager::allocator_allocated;
+  lst.Assign(source.begin(), source.end());
+REQUIRE(Contents(lst) == source);
+REQUIRE(MemoryManager::allocator_allocated == allocated + 2);
+
+std::istringstream input("5 4 3");
+  lst.Assign(std::istream_iterator<int>(input), std::istream_iterator<int>());
+REQUIRE(Contents(lst) == std::vector<int>{5, 4, 3});
+  lst.Assign(0, 1);
+REQUIRE(lst.Empty());
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("Assign leaves the list unchanged if a copy throws", "[List: assign]") {
+ThrowOnCopy::copies_left = 100;
+List<ThrowOnCopy> lst;
+  lst.EmplaceBack(1);
+std::vector<ThrowOnCopy> source;
+for (int i = 10; i < 15; ++i) {
+  source.emplace_back(i);
+}
+ThrowOnCopy::copies_left = 2;
+REQUIRE_THROWS(lst.Assign(source.begin(), source.end()));
+REQUIRE(lst.Size() == 1);
+REQUIRE(lst.Front().value == 1);
+}
+
+TEST_CASE("Copy assignment of throwing elements reuses nodes", "[List: assign]") {
+SetupTest();
+{
+List<ThrowOnAssign, AllocatorWithCount<ThrowOnAssign>> lst;
+List<ThrowOnAssign, AllocatorWithCount<ThrowOnAssign>> other;
+for (int i = 0; i < 5; ++i) {
+  lst.EmplaceBack(i);
+  other.EmplaceBack(10 + i);
+}
+size_t allocated = MemoryManager::allocator_allocated;
+size_t deallocated = MemoryManager::allocator_deallocated;
+ThrowOnAssign::assignments_left = 100;
+  lst = other;
+REQUIRE(MemoryManager::allocator_allocated == allocated);
+REQUIRE(MemoryManager::allocator_deallocated == deallocated);
+std::vector<int> values;
+for (const ThrowOnAssign& element : lst) {
+  values.push_back(element.value);
+}
+REQUIRE(values == std::vector<int>{10, 11, 12, 13, 14});
+
+// A throwing assignment gives the basic guarantee: the size is kept and
+// the elements before the failure are already overwritten.
+List<ThrowOnAssign, AllocatorWithCount<ThrowOnAssign>> third;
+for (int i = 0; i < 5; ++i) {
+  third.EmplaceBack(20 + i);
+}
+ThrowOnAssign::assignments_left = 2;
+REQUIRE_THROWS(lst = third);
+REQUIRE(lst.Size() == 5);
+values.clear();
+for (const ThrowOnAssign& element : lst) {
+  values.push_back(element.value);
+}
+REQUIRE(values == std::vector<int>{20, 21, 12, 13, 14});
+REQUIRE(MemoryManager::allocator_allocated == allocated + 5);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("Bulk traversal", "[List: traversal]") {
+List<int> lst;
+for (int i = 1; i <= 100; ++i) {
+  lst.PushBack(i);
+}
+for (size_t distance : {0, 1, 8, 1000}) {
+REQUIRE(lst.Accumulate(0, std::plus<>(), distance) == 5050);
+REQUIRE(lst.CountIf([](int x) { return x % 3 == 0; }) == 33);
+auto it = lst.FindIf([](int x) { return x > 41; }, distance);
+REQUIRE(*it == 42);
+bool at_end = lst.FindIf([](int x) { return x > 100; }, distance) == lst.End();
+REQUIRE(at_end);
+}
+  lst.ForEach([](int& x) { x *= 2; });
+const List<int>& view = lst;
+long long sum = 0;
+  view.ForEach([&sum](const int& x) { sum += x; }, 4);
+REQUIRE(sum == 10100);
+List<int> empty;
+REQUIRE(empty.Accumulate(7) == 7);
+REQUIRE(empty.CountIf([](int) { return true; }) == 0);
+  lst.PopBack();
+REQUIRE(lst.CountIf([](int x) { return x > 100; }) == 49);
+}
+
+TEST_CASE("Compact relocates nodes into one slab in list order", "[List: compact]") {
+SetupTest();
+auto Contents = [](const List<int, AllocatorWithCount<int>>& lst) {
+  return std::vector<int>(lst.Cbegin(), lst.Cend());
+};
+auto IsSequential = [](List<int, AllocatorWithCount<int>>& lst) {
+  const int* previous = nullptr;
+  std::ptrdiff_t stride = 0;
+  for (auto it = lst.Begin(); it != lst.End(); ++it) {
+    const int* current = &*it;
+    if (previous != nullptr) {
+      if (stride == 0) {
+        stride = current - previous;
+      }
+      if (stride <= 0 || current - previous != stride) {
+        return false;
+      }
+    }
+    previous = current;
+  }
+  return true;
+};
+{
+List<int, AllocatorWithCount<int>> lst;
+for (int i = 0; i < 500; ++i) {
+  lst.PushBack(i);
+  lst.PushFront(-i);
+}
+std::vector<int> expected = Contents(lst);
+size_t allocated = MemoryManager::allocator_allocated;
+size_t deallocated = MemoryManager::allocator_deallocated;
+  lst.Compact();
+REQUIRE(Contents(lst) == expected);
+REQUIRE(IsSequential(lst));
+// slab table, slab bookkeeping and the slab; every heap node is freed
+REQUIRE(MemoryManager::allocator_allocated == allocated + 3);
+REQUIRE(MemoryManager::allocator_deallocated == deallocated + 1000);
+
+  lst.PopFront();
+  lst.PushBack(1000);
+  lst.Compact();
+expected.erase(expected.begin());
+expected.push_back(1000);
+REQUIRE(Contents(lst) == expected);
+REQUIRE(IsSequential(lst));
+// the old slab is not shared, so it is freed
+REQUIRE(MemoryManager::allocator_allocated == allocated + 5);
+REQUIRE(MemoryManager::allocator_deallocated == deallocated + 1002);
+
+List<int, AllocatorWithCount<int>> stepped;
+for (int i = 0; i < 100; ++i) {
+  stepped.PushFront(i);
+}
+REQUIRE_FALSE(stepped.CompactStep(30));
+  stepped.PopFront();
+  stepped.PushBack(-1);
+REQUIRE_FALSE(stepped.CompactStep(30));
+  stepped.Erase(std::next(stepped.Cbegin(), 60));
+REQUIRE_FALSE(stepped.CompactStep(30));
+REQUIRE(stepped.CompactStep(30));
+std::vector<int> stepped_expected;
+for (int i = 98; i >= 0; --i) {
+  if (i != 38) {
+    stepped_expected.push_back(i);
+  }
+}
+stepped_expected.push_back(-1);
+REQUIRE(Contents(stepped) == stepped_expected);
+REQUIRE(IsSequential(stepped));
+
+List<int, AllocatorWithCount<int>> empty;
+  empty.Compact();
+REQUIRE(empty.CompactStep(10));
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+size_t live_bytes = 0;
+
+template <typename T>
+struct ByteCountingAllocator {
+  using value_type = T;
+  ByteCountingAllocator() = default;
+  template <typename U>
+  ByteCountingAllocator(const ByteCountingAllocator<U>&) {}
+  T* allocate(size_t n) {
+    live_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) {
+    live_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+  bool operator==(const ByteCountingAllocator&) const { return true; }
+  bool operator!=(const ByteCountingAllocator&) const { return false; }
+};
+
+// Remembers which allocator allocated every block and checks that the same
+// one frees it.
+std::unordered_map<void*, int> block_owners;
+
+template <typename T>
+struct OwnerCheckingAllocator {
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  explicit OwnerCheckingAllocator(int id) : id(id) {}
+  template <typename U>
+  OwnerCheckingAllocator(const OwnerCheckingAllocator<U>& other) : id(other.id) {}
+  T* allocate(size_t n) {
+    T* p = std::allocator<T>().allocate(n);
+    block_owners[p] = id;
+    return p;
+  }
+  void deallocate(T* p, size_t n) {
+    REQUIRE(block_owners.at(p) == id);
+    block_owners.erase(p);
+    std::allocator<T>().deallocate(p, n);
+  }
+  bool operator==(const OwnerCheckingAllocator& other) const { return id == other.id; }
+  bool operator!=(const OwnerCheckingAllocator& other) const { return id != other.id; }
+  int id;
+};
+
+TEST_CASE("Move assignment with unequal propagating allocators", "[List: AssOperator]") {
+{
+List<int, OwnerCheckingAllocator<int>> first(OwnerCheckingAllocator<int>(1));
+List<int, OwnerCheckingAllocator<int>> second(OwnerCheckingAllocator<int>(2));
+  first.SetNodeCacheLimit(10);
+  second.SetNodeCacheLimit(10);
+for (int i = 0; i < 20; ++i) {
+    first.PushBack(i);
+    second.PushBack(-i);
+}
+for (int i = 0; i < 5; ++i) {
+    first.PopBack();
+    second.PopFront();
+}
+REQUIRE(first.CachedNodes() == 5);
+  first = std::move(second);
+REQUIRE(first.GetAllocator().id == 2);
+REQUIRE(first.Size() == 15);
+REQUIRE(first.Front() == -5);
+for (int i = 0; i < 20; ++i) {
+    first.PushBack(i);
+}
+  first.ShrinkToFit();
+}
+REQUIRE(block_owners.empty());
+}
+
+// An owner checking allocator that is swapped along with the containers and
+// has no owner once moved from.
+template <typename T>
+struct SwappedOwnerAllocator {
+  using value_type = T;
+  using propagate_on_container_swap = std::true_type;
+  explicit SwappedOwnerAllocator(int id) : id(id) {}
+  SwappedOwnerAllocator(const SwappedOwnerAllocator&) = default;
+  SwappedOwnerAllocator(SwappedOwnerAllocator&& other) noexcept : id(other.id) {
+    other.id = 0;
+  }
+  template <typename U>
+  SwappedOwnerAllocator(const SwappedOwnerAllocator<U>& other) : id(other.id) {}
+  SwappedOwnerAllocator& operator=(const SwappedOwnerAllocator&) = default;
+  SwappedOwnerAllocator& operator=(SwappedOwnerAllocator&& other) noexcept {
+    id = other.id;
+    other.id = 0;
+    return *this;
+  }
+  T* allocate(size_t n) {
+    T* p = std::allocator<T>().allocate(n);
+    block_owners[p] = id;
+    return p;
+  }
+  void deallocate(T* p, size_t n) {
+    REQUIRE(block_owners.at(p) == id);
+    block_owners.erase(p);
+    std::allocator<T>().deallocate(p, n);
+  }
+  bool operator==(const SwappedOwnerAllocator& other) const { return id == other.id; }
+  bool operator!=(const SwappedOwnerAllocator& other) const { return id != other.id; }
+  int id;
+};
+
+TEST_CASE("XorList Swap exchanges propagating allocators", "[XorList]") {
+{
+XorList<int, SwappedOwnerAllocator<int>> first(0, SwappedOwnerAllocator<int>(1));
+XorList<int, SwappedOwnerAllocator<int>> second(0, SwappedOwnerAllocator<int>(2));
+for (int i = 0; i < 3; ++i) {
+    first.PushBack(i);
+}
+  second.PushBack(10);
+  first.Swap(second);
+REQUIRE(first.GetAllocator().id == 2);
+REQUIRE(second.GetAllocator().id == 1);
+REQUIRE(first.Size() == 1);
+REQUIRE(first.Front() == 10);
+REQUIRE(second.Size() == 3);
+REQUIRE(second.Front() == 0);
+REQUIRE(second.Back() == 2);
+REQUIRE(*++second.Begin() == 1);
+REQUIRE(*--second.End() == 2);
+
+XorList<int, SwappedOwnerAllocator<int>> empty(0, SwappedOwnerAllocator<int>(3));
+  empty.Swap(second);
+REQUIRE(second.Empty());
+REQUIRE(second.Begin() == second.End());
+  second.PushFront(7);
+REQUIRE(empty.Size() == 3);
+  empty.PopFront();
+REQUIRE(empty.Front() == 1);
+  first.Swap(first);
+REQUIRE(first.Front() == 10);
+}
+REQUIRE(block_owners.empty());
+}
+
+TEST_CASE("Repeated CompactStep passes keep memory bounded", "[List: compact]") {
+live_bytes = 0;
+{
+List<int, ByteCountingAllocator<int>> lst;
+for (int i = 0; i < 1000; ++i) {
+  lst.PushBack(i);
+}
+auto Pass = [&lst] {
+  while (!lst.CompactStep(64)) {
+      lst.PopFront();
+      lst.PushBack(lst.Back() + 1);
+  }
+};
+  Pass();
+size_t after_first = live_bytes;
+for (int pass = 0; pass < 200; ++pass) {
+    Pass();
+}
+REQUIRE(live_bytes <= after_first);
+REQUIRE(lst.Size() == 1000);
+REQUIRE(lst.Back() - lst.Front() == 999);
+
+// A pass that leaves an element behind can not free the old slabs, the next
+// complete one does.
+  lst.CompactStep(500);
+  lst.PushFront(-1);
+while (!lst.CompactStep(500)) {
+}
+  Pass();
+  Pass();
+REQUIRE(live_bytes <= after_first + 64);
+}
+REQUIRE(live_bytes == 0);
+}
+
+TEST_CASE("Compact keeps every value if a copy throws", "[List: compact]") {
+ThrowOnCopy::copies_left = 100;
+List<ThrowOnCopy> lst;
+for (int i = 0; i < 5; ++i) {
+  lst.EmplaceBack(i);
+}
+ThrowOnCopy::copies_left = 2;
+REQUIRE_THROWS(lst.Compact());
+std::vector<int> values;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+  values.push_back(it->value);
+}
+REQUIRE(values == std::vector<int>{0, 1, 2, 3, 4});
+ThrowOnCopy::copies_left = 100;
+  lst.Compact();
+REQUIRE(lst.Size() == 5);
+REQUIRE(lst.Back().value == 4);
+}
+
+TEST_CASE("Teardown frees spliced heap nodes of slab lists", "[List: teardown]") {
+SetupTest();
+{
+List<int, AllocatorWithCount<int>> slab(100, 1);
+List<int, AllocatorWithCount<int>> heap;
+for (int i = 0; i < 10; ++i) {
+  heap.PushBack(i);
+}
+  slab.Splice(slab.Cbegin(), heap, heap.Cbegin());
+  slab.Splice(slab.Cend(), heap, std::next(heap.Cbegin(), 2), heap.Cend());
+  heap.Splice(heap.Cend(), slab, slab.Cbegin());
+  slab.PopBack();
+REQUIRE(slab.Size() == 106);
+REQUIRE(heap.Size() == 3);
+List<int, AllocatorWithCount<int>> compacted = heap;
+  compacted.Splice(compacted.Cend(), heap);
+  compacted.Compact();
+  compacted.PushBack(5);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+}
+
+TEST_CASE("SerializeTo and Deserialize", "[List: serialization]") {
+SetupTest();
+using CountedList = List<long long, AllocatorWithCount<long long>>;
+auto Contents = [](const CountedList& lst) {
+  return std::vector<long long>(lst.Cbegin(), lst.Cend());
+};
+{
+CountedList lst;
+for (long long i = 0; i < 20000; ++i) {
+  lst.PushFront(i * i);
+}
+std::stringstream stream;
+  lst.SerializeTo(stream);
+size_t allocated = MemoryManager::allocator_allocated;
+CountedList copy = CountedList::Deserialize(stream);
+REQUIRE(Contents(copy) == Contents(lst));
+// slab table, slab bookkeeping and the slab
+REQUIRE(MemoryManager::allocator_allocated == allocated + 3);
+
+std::stringstream empty_stream;
+  CountedList().SerializeTo(empty_stream);
+REQUIRE(CountedList::Deserialize(empty_stream).Empty());
+
+std::string truncated = stream.str();
+truncated.resize(truncated.size() - 1);
+std::stringstream truncated_stream(truncated);
+REQUIRE_THROWS_AS(CountedList::Deserialize(truncated_stream), std::runtime_error);
+std::stringstream wrong_type(stream.str());
+REQUIRE_THROWS_AS(List<int>::Deserialize(wrong_type), std::runtime_error);
+
+std::stringstream chunked(stream.str());
+CountedList::Reader reader(chunked);
+REQUIRE(reader.Remaining() == 20000);
+std::vector<long long> loaded;
+while (reader.Remaining() > 0) {
+CountedList chunk = reader.Next(3000);
+REQUIRE(chunk.Size() <= 3000);
+loaded.insert(loaded.end(), chunk.Cbegin(), chunk.Cend());
+}
+REQUIRE(loaded == Contents(lst));
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+REQUIRE(MemoryManager::allocator_constructed == MemoryManager::allocator_destroyed);
+
+#if LIST_POSIX_IO
+List<int> numbers{1, 2, 3, 4, 5};
+std::FILE* file = std::tmpfile();
+REQUIRE(file != nullptr);
+  numbers.SerializeTo(fileno(file));
+REQUIRE(lseek(fileno(file), 0, SEEK_SET) == 0);
+List<int> read_back = List<int>::Deserialize(fileno(file));
+REQUIRE(AreListsEqual(read_back, numbers));
+std::fclose(file);
+#endif
+}
+
+#if LIST_POSIX_IO
+TEST_CASE("PersistentList survives reopening", "[PersistentList]") {
+char path[] = "/tmp/persistent_list_XXXXXX";
+int fd = mkstemp(path);
+REQUIRE(fd >= 0);
+close(fd);
+struct Point {
+  int x;
+  double y;
+};
+{
+PersistentList<Point> lst(path, 4096);
+REQUIRE(lst.Empty());
+for (int i = 0; i < 10000; ++i) {
+  lst.PushBack({i, i / 2.0});
+}
+  lst.PushFront({-1, 0});
+  lst.PopBack();
+  lst.PopFront();
+  lst.PushBack(lst.Front());
+REQUIRE(lst.MappedBytes() > 4096);
+  lst.Flush();
+}
+{
+PersistentList<Point> lst(path);
+REQUIRE(lst.Size() == 10000);
+std::vector<int> xs;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+  xs.push_back(it->x);
+}
+std::vector<int> expected(9999);
+std::iota(expected.begin(), expected.end(), 0);
+expected.push_back(0);
+REQUIRE(xs == expected);
+size_t mapped = lst.MappedBytes();
+  lst.Clear();
+REQUIRE(lst.Empty());
+for (int i = 0; i < 10000; ++i) {
+  lst.PushFront({i, 0});
+}
+REQUIRE(lst.MappedBytes() == mapped);
+REQUIRE(lst.Front().x == 9999);
+}
+REQUIRE_THROWS_AS(PersistentList<char>(path), std::runtime_error);
+unlink(path);
+}
+
+TEST_CASE("PersistentList pop on empty", "[PersistentList]") {
+char path[] = "/tmp/persistent_list_XXXXXX";
+int fd = mkstemp(path);
+REQUIRE(fd >= 0);
+close(fd);
+{
+PersistentList<int> lst(path);
+  lst.PopBack();
+  lst.PopFront();
+REQUIRE(lst.Empty());
+  lst.PushBack(1);
+  lst.PushBack(2);
+  lst.PopFront();
+  lst.PopFront();
+  lst.PopFront();
+  lst.PopBack();
+  lst.PushBack(3);
+  lst.PushFront(4);
+}
+{
+PersistentList<int> lst(path);
+REQUIRE(lst.Size() == 2);
+std::vector<int> values;
+for (auto it = lst.Begin(); it != lst.End(); ++it) {
+  values.push_back(*it);
+}
+REQUIRE(values == std::vector<int>{4, 3});
+}
+unlink(path);
+}
+#endif
+
+TEST_CASE("Parallel algorithms", "[List: parallel]") {
+List<int> lst;
+for (int i = 1; i <= 1000; ++i) {
+  lst.PushBack(i);
+}
+for (size_t threads : {0, 1, 2, 3, 7, 1000, 5000}) {
+REQUIRE(lst.ParallelReduce(0LL, std::plus<>(), threads) == 500500);
+std::string digits = lst.ParallelTransformReduce(
+    std::string(), std::plus<>(),
+    [](int x) { return std::to_string(x % 10); }, threads);
+std::string expected;
+for (int i = 1; i <= 1000; ++i) {
+  expected += std::to_string(i % 10);
+}
+REQUIRE(digits == expected);
+}
+List<int>::Segments segments = lst.Split(6);
+REQUIRE(segments.Count() == 6);
+  lst.ParallelForEach([](int& x) { x *= 2; }, segments);
+REQUIRE(lst.ParallelReduce(0LL, std::plus<>(), segments) == 1001000);
+std::atomic<long long> sum{0};
+const List<int>& view = lst;
+  view.ParallelForEach([&sum](const int& x) { sum += x; }, 4);
+REQUIRE(sum == 1001000);
+REQUIRE_THROWS_AS(lst.ParallelForEach(
+                      [](int x) {
+                        if (x == 700) {
+                          throw std::runtime_error("700");
+                        }
+                      },
+                      3),
+                  std::runtime_error);
+List<int> empty;
+REQUIRE(empty.Split().Count() == 1);
+REQUIRE(empty.ParallelReduce(5) == 5);
+}
+
+TEST_CASE("Positional index follows pushes and pops", "[List: position index]") {
+std::mt19937 random(7);
+for (size_t stride : {0, 1, 3, 16}) {
+List<int> lst;
+  lst.SetPositionIndexStride(stride);
+std::deque<int> model;
+for (int step = 0; step < 2000; ++step) {
+  switch (random() % 6) {
+    case 0:
+    case 1:
+      lst.PushBack(step);
+      model.push_back(step);
+      break;
+    case 2:
+      lst.PushFront(step);
+      model.push_front(step);
+      break;
+    case 3:
+      lst.PopBack();
+      if (!model.empty()) {
+        model.pop_back();
+      }
+      break;
+    case 4:
+      lst.PopFront();
+      if (!model.empty()) {
+        model.pop_front();
+      }
+      break;
+    default:
+      // Anything but the end pushes and pops drops the index.
+      if (step % 100 == 0 && !model.empty()) {
+        lst.Erase(lst.Advance(lst.Cbegin(), static_cast<std::ptrdiff_t>(model.size() / 2)));
+        model.erase(model.begin() + static_cast<std::ptrdiff_t>(model.size() / 2));
+      }
+  }
+  if (model.empty()) {
+    continue;
+  }
+  size_t i = random() % model.size();
+  REQUIRE(lst.At(i) == model[i]);
+  auto it = lst.Advance(lst.Cbegin(), static_cast<std::ptrdiff_t>(i));
+  REQUIRE(*it == model[i]);
+  REQUIRE(lst.Distance(lst.Cbegin(), it) == static_cast<std::ptrdiff_t>(i));
+  REQUIRE(lst.Distance(it, lst.Cend()) == static_cast<std::ptrdiff_t>(model.size() - i));
+  bool back_at_begin = lst.Advance(it, -static_cast<std::ptrdiff_t>(i)) == lst.Begin();
+  REQUIRE(back_at_begin);
+}
+if (stride != 0) {
+REQUIRE(lst.PositionIndexBytes() > 0);
+size_t bytes = lst.PositionIndexBytes();
+  lst.SetPositionIndexStride(0);
+REQUIRE(lst.PositionIndexBytes() < bytes);
+}
+}
+}
+
+TEST_CASE("Const positional queries do not build the index", "[List: position index]") {
+List<int> lst;
+for (int i = 0; i < 1000; ++i) {
+  lst.PushBack(i);
+}
+  lst.SetPositionIndexStride(16);
+const List<int>& view = lst;
+long long expected = 0;
+for (size_t i = 0; i < 1000; i += 7) {
+  expected += 2 * static_cast<long long>(i);
+}
+std::vector<long long> sums(4);
+std::vector<std::thread> readers;
+for (size_t r = 0; r < sums.size(); ++r) {
+  readers.emplace_back([&view, &sums, r] {
+    long long sum = 0;
+    for (size_t i = 0; i < 1000; i += 7) {
+      sum += view.At(i);
+      sum += view.Distance(view.Cbegin(), view.Advance(view.Cbegin(), static_cast<std::ptrdiff_t>(i)));
+    }
+    sums[r] = sum;
+  });
+}
+for (std::thread& reader : readers) {
+  reader.join();
+}
+for (long long sum : sums) {
+REQUIRE(sum == expected);
+}
+REQUIRE(lst.PositionIndexBytes() == 0);
+
+// A non-const query builds it, const queries use it from then on.
+REQUIRE(lst.At(500) == 500);
+size_t bytes = lst.PositionIndexBytes();
+REQUIRE(bytes > 0);
+REQUIRE(view.At(999) == 999);
+REQUIRE(view.Distance(view.Advance(view.Cbegin(), 10), view.Cend()) == 990);
+REQUIRE(lst.PositionIndexBytes() == bytes);
+}
+
+TEST_CASE("SortedList", "[SortedList]") {
+SetupTest();
+{
+std::mt19937 random(11);
+SortedList<int, std::less<int>, AllocatorWithCount<int>> sorted;
+std::multiset<int> model;
+for (int step = 0; step < 5000; ++step) {
+  int value = static_cast<int>(random() % 1000);
+  if (random() % 3 != 0) {
+    sorted.Insert(value);
+    model.insert(value);
+  } else {
+    auto it = sorted.Find(value);
+    bool found = it != sorted.End();
+    REQUIRE(found == (model.count(value) != 0));
+    if (found) {
+      REQUIRE(*it.operator->() == value);
+      sorted.Erase(it);
+      model.erase(model.find(value));
+    }
+  }
+}
+REQUIRE(sorted.Size() == model.size());
+REQUIRE(std::vector<int>(sorted.Cbegin(), sorted.Cend()) ==
+        std::vector<int>(model.begin(), model.end()));
+for (int value : {-1, 0, 500, 999, 1000}) {
+  auto it = sorted.LowerBound(value);
+  auto expected = model.lower_bound(value);
+  bool both_end = (it == sorted.End()) == (expected == model.end());
+  REQUIRE(both_end);
+  if (expected != model.end()) {
+    REQUIRE(*it.operator->() == *expected);
+  }
+}
+size_t count = model.count(500);
+REQUIRE(sorted.Erase(500) == count);
+bool erased = sorted.Find(500) == sorted.End();
+REQUIRE(erased);
+SortedList<int, std::less<int>, AllocatorWithCount<int>> moved(std::move(sorted));
+REQUIRE(moved.Size() == model.size() - count);
+  moved.Insert(500);
+bool inserted = moved.Find(500) != moved.End();
+REQUIRE(inserted);
+  moved.Clear();
+REQUIRE(moved.Empty());
+  moved.Insert(1);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+
+// Equivalent elements stay in insertion order.
+SortedList<std::pair<int, int>, bool (*)(const std::pair<int, int>&, const std::pair<int, int>&)> pairs(
+    [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; });
+for (int i = 0; i < 100; ++i) {
+  pairs.Insert(std::make_pair(i % 3, i));
+}
+int previous = -1;
+for (auto it = pairs.Begin(); it != pairs.End(); ++it) {
+  if (it->first == 1) {
+    REQUIRE(it->second > previous);
+    previous = it->second;
+  }
+}
+}
+
+TEST_CASE("LruCache", "[LruCache]") {
+SetupTest();
+{
+std::mt19937 random(13);
+LruCache<int, int, AllocatorWithCount<std::pair<int, int>>> cache(64);
+std::list<std::pair<int, int>> model;
+size_t hits = 0;
+size_t misses = 0;
+size_t evictions = 0;
+for (int step = 0; step < 20000; ++step) {
+  int key = static_cast<int>(random() % 128);
+  auto it = std::find_if(model.begin(), model.end(),
+                         [key](const std::pair<int, int>& e) { return e.first == key; });
+  if (random() % 2 == 0) {
+    int* value = cache.Get(key);
+    REQUIRE((value != nullptr) == (it != model.end()));
+    if (value != nullptr) {
+      REQUIRE(*value == it->second);
+      model.splice(model.begin(), model, it);
+      ++hits;
+    } else {
+      ++misses;
+    }
+  } else {
+      cache.Put(key, step);
+    if (it != model.end()) {
+      model.erase(it);
+    } else if (model.size() == cache.Capacity()) {
+      model.pop_back();
+      ++evictions;
+    }
+    model.emplace_front(key, step);
+  }
+  REQUIRE(cache.Size() == model.size());
+}
+static_assert(std::is_const_v<std::remove_reference_t<decltype(*cache.Cbegin())>>);
+REQUIRE(std::vector<std::pair<int, int>>(cache.begin(), cache.end()) ==
+        std::vector<std::pair<int, int>>(model.begin(), model.end()));
+REQUIRE(cache.Stats().hits == hits);
+REQUIRE(cache.Stats().misses == misses);
+REQUIRE(cache.Stats().evictions == evictions);
+
+// A full cache evicts into the nodes it already has.
+std::set<const std::pair<int, int>*> nodes;
+for (auto it = cache.Cbegin(); it != cache.Cend(); ++it) {
+  nodes.insert(it.operator->());
+}
+for (int key = 1000; key < 2000; ++key) {
+    cache.Put(key, key);
+}
+for (auto it = cache.Cbegin(); it != cache.Cend(); ++it) {
+  REQUIRE(nodes.count(it.operator->()) == 1);
+}
+REQUIRE(cache.Cbegin()->first == 1999);
+REQUIRE(!cache.Contains(1000));
+REQUIRE(cache.Contains(1936));
+REQUIRE(cache.Erase(1936));
+REQUIRE(!cache.Erase(1936));
+REQUIRE(cache.Size() == 63);
+  cache.ResetStats();
+REQUIRE(cache.Get(1936) == nullptr);
+REQUIRE(cache.Stats().misses == 1);
+  cache.Clear();
+REQUIRE(cache.Empty());
+  cache.Put(1, 1);
+REQUIRE(*cache.Get(1) == 1);
+
+static_assert(!std::is_copy_constructible_v<decltype(cache)>);
+static_assert(!std::is_copy_assignable_v<decltype(cache)>);
+auto moved = std::make_unique<decltype(cache)>(std::move(cache));
+for (int key = 0; key < 100; ++key) {
+    moved->Put(key, key);
+}
+REQUIRE(moved->Size() == 64);
+REQUIRE(*moved->Get(99) == 99);
+REQUIRE(moved->Get(35) == nullptr);
+  cache = std::move(*moved);
+  moved.reset();
+REQUIRE(*cache.Get(36) == 36);
+  cache.Put(200, 200);
+REQUIRE(!cache.Contains(37));
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+}
+
+TEST_CASE("ClearAsync hands the nodes to a reclaimer", "[ClearAsync]") {
+SetupTest();
+{
+std::vector<ListReclaimer::Task> tasks;
+ListReclaimer reclaimer([&tasks](ListReclaimer::Task task) { tasks.push_back(std::move(task)); }, 150);
+List<int, AllocatorWithCount<int>> list(50, 7);
+for (int i = 0; i < 50; ++i) {
+    list.PushBack(i);
+}
+  list.SetReclaimer(&reclaimer);
+  list.ClearAsync();
+REQUIRE(list.Empty());
+REQUIRE(tasks.size() == 1);
+REQUIRE(reclaimer.Backlog() == 100);
+REQUIRE(MemoryManager::allocator_allocated != MemoryManager::allocator_deallocated);
+  list.PushBack(1);
+  list.PushFront(0);
+REQUIRE(list.Size() == 2);
+REQUIRE(list.Front() == 0);
+REQUIRE(list.Back() == 1);
+
+// Over the bound: cleared on the spot.
+List<int, AllocatorWithCount<int>> big(100, 1);
+  big.SetReclaimer(&reclaimer);
+  big.ClearAsync();
+REQUIRE(big.Empty());
+REQUIRE(tasks.size() == 1);
+REQUIRE(reclaimer.Backlog() == 100);
+
+// Shared slabs are handed over too; the other list keeps its own.
+List<int, AllocatorWithCount<int>> other(10, 2);
+  big.Assign(5, 3);
+  big.Splice(big.Cend(), other, other.Cbegin());
+  big.ClearAsync();
+REQUIRE(big.Empty());
+REQUIRE(tasks.size() == 2);
+REQUIRE(reclaimer.Backlog() == 106);
+
+  tasks[0]();
+  tasks[1]();
+REQUIRE(reclaimer.Backlog() == 0);
+REQUIRE(other.Size() == 9);
+REQUIRE(std::count(other.Begin(), other.End(), 2) == 9);
+
+// A chain larger than the bound still goes if the backlog is empty.
+{
+List<int, AllocatorWithCount<int>> dying(List<int>::kDeferredDestroyMinSize, 5);
+  dying.SetReclaimer(&reclaimer);
+}
+REQUIRE(tasks.size() == 3);
+REQUIRE(reclaimer.Backlog() == List<int>::kDeferredDestroyMinSize);
+  tasks[2]();
+REQUIRE(reclaimer.Backlog() == 0);
+}
+REQUIRE(MemoryManager::allocator_allocated == MemoryManager::allocator_deallocated);
+
+ListReclaimer reclaimer;
+List<std::string> strings;
+for (int round = 0; round < 20; ++round) {
+  for (int i = 0; i < 1000; ++i) {
+      strings.PushBack(std::string(32, static_cast<char>('a' + round)));
+  }
+    strings.ClearAsync();
+  REQUIRE(strings.Empty());
+}
+  strings.SetReclaimer(&reclaimer);
+for (int i = 0; i < 1000; ++i) {
+    strings.PushBack(std::to_string(i));
+}
+  strings.ClearAsync();
+  reclaimer.Flush();
+REQUIRE(reclaimer.Backlog() == 0);
+  ListReclaimer::Default().Flush();
+REQUIRE(ListReclaimer::Default().Backlog() == 0);
+}
+
+static_assert(std::bidirectional_iterator<List<int>::iterator>);
+static_assert(std::bidirectional_iterator<List<int>::const_iterator>);
+static_assert(std::is_same_v<std::iter_reference_t<List<int>::const_iterator>, const int&>);
+static_assert(std::is_convertible_v<List<int>::iterator, List<int>::const_iterator>);
+static_assert(!std::is_convertible_v<List<int>::const_iterator, List<int>::iterator>);
+static_assert(std::ranges::bidirectional_range<List<int>>);
+static_assert(std::ranges::bidirectional_range<const List<int>>);
+static_assert(std::ranges::sized_range<List<int>>);
+static_assert(std::ranges::viewable_range<List<int>&>);
+
+TEST_CASE("Iterators are standard bidirectional iterators", "[List: Iterators]") {
+List<std::string> words{"one", "two", "three", "four"};
+const List<std::string>& view = words;
+REQUIRE(&*view.begin() == &words.Front());
+REQUIRE(&*words.Cbegin() == &words.Front());
+REQUIRE(words.Begin() == words.Cbegin());
+REQUIRE(words.Cend() == words.End());
+REQUIRE(std::vector<std::string>(words.Crbegin(), words.Crend()) ==
+        std::vector<std::string>{"four", "three", "two", "one"});
+REQUIRE(*words.Rbegin() == "four");
+
+auto it = words.Begin();
+REQUIRE(*it++ == "one");
+REQUIRE(*it-- == "two");
+REQUIRE(*it == "one");
+
+for (std::string& word : words) {
+    word += "!";
+}
+REQUIRE(std::accumulate(view.begin(), view.end(), size_t{0},
+                        [](size_t sum, const std::string& word) { return sum + word.size(); }) == 19);
+REQUIRE(std::find(view.begin(), view.end(), "three!") == std::next(view.begin(), 2));
+REQUIRE(std::ranges::find(words, "four!") == std::prev(words.end()));
+
+auto lengths = words | std::views::reverse |
+               std::views::transform([](const std::string& word) { return word.size(); });
+REQUIRE(std::vector<size_t>(lengths.begin(), lengths.end()) == std::vector<size_t>{5, 6, 4, 4});
+REQUIRE(std::ranges::distance(std::views::all(words)) == 4);
+}